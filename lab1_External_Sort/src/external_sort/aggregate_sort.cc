@@ -0,0 +1,296 @@
+#include "external_sort/external_sort.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "external_sort/io_thread.h"
+#include "external_sort/loser_tree.h"
+#include "external_sort/radix_sort.h"
+#include "external_sort/run_codec.h"
+#include "external_sort/run_io.h"
+#include "storage/file.h"
+
+namespace buzzdb {
+
+namespace {
+
+using detail::Run;
+
+/// Key extractor of `ValueCount`s.
+struct ValueKey {
+    uint64_t operator()(const ValueCount &record) const { return record.value; }
+};
+
+/// Aggregation of `external_sort_distinct()`: runs hold every value once.
+struct Distinct {
+    using Record = uint64_t;
+    using KeyFn = IdentityKey;
+
+    static Record make(uint64_t value, uint64_t /*count*/) { return value; }
+    static void add(Record & /*into*/, const Record & /*from*/) {}
+};
+
+/// Aggregation of `external_sort_count()`: runs hold every value once,
+/// together with the number of its occurrences.
+struct Count {
+    using Record = ValueCount;
+    using KeyFn = ValueKey;
+
+    static Record make(uint64_t value, uint64_t count) { return {value, count}; }
+    static void add(Record &into, const Record &from) { into.count += from.count; }
+};
+
+/// Appends the records of a stream that is sorted by key to a writer, and
+/// combines the records with equal keys into one.
+template <typename Aggregate>
+class Combiner {
+ public:
+    using Record = typename Aggregate::Record;
+
+    /// Constructor. At most `limit` records are appended to `writer`.
+    Combiner(BasicRunWriter<Record> &writer, size_t limit) : writer_(writer), limit_(limit) {}
+
+    /// Adds a record whose key is not smaller than the ones that were added
+    /// before. Returns false, without adding it, if the record would start
+    /// the `limit + 1`-th group.
+    bool add(const Record &record) {
+        if (num_records_ > 0 && key(record) == key(pending_)) {
+            Aggregate::add(pending_, record);
+            return true;
+        }
+        if (num_records_ == limit_) {
+            return false;
+        }
+        if (num_records_ > 0) {
+            writer_.append(pending_);
+        }
+        pending_ = record;
+        num_records_++;
+        return true;
+    }
+
+    /// Appends the last record and returns the number of appended records.
+    size_t finish() {
+        if (num_records_ > 0) {
+            writer_.append(pending_);
+        }
+        return num_records_;
+    }
+
+ private:
+    static uint64_t key(const Record &record) { return typename Aggregate::KeyFn{}(record); }
+
+    /// The writer that the combined records are appended to.
+    BasicRunWriter<Record> &writer_;
+    /// Maximum number of records.
+    size_t limit_;
+    /// Number of records, including the pending one.
+    size_t num_records_ = 0;
+    /// The record that further records with the same key are combined into.
+    Record pending_{};
+};
+
+/// Appends one record per distinct value of the sorted `values[0,
+/// num_values)` to `writer`, but at most `limit`. Returns the number of
+/// appended records.
+template <typename Aggregate>
+size_t write_groups(const uint64_t *values, size_t num_values,
+                    BasicRunWriter<typename Aggregate::Record> &writer, size_t limit) {
+    size_t num_records = 0;
+    for (size_t i = 0; i < num_values && num_records < limit; num_records++) {
+        size_t end = i + 1;
+        while (end < num_values && values[end] == values[i]) {
+            end++;
+        }
+        writer.append(Aggregate::make(values[i], end - i));
+        i = end;
+    }
+    return num_records;
+}
+
+/// The records and bytes that a merge wrote.
+struct MergeResult {
+    size_t num_records;
+    size_t size;
+};
+
+/// Merges `runs`, which are stored in `format` in `spill`, combines records
+/// with equal keys and writes the first `limit` records to `output` in
+/// `output_format` starting at `offset`.
+template <typename Aggregate>
+MergeResult merge_groups(const std::vector<Run> &runs, RunFormat format,
+                         const detail::SpillArea &spill, File &output, size_t offset,
+                         RunFormat output_format, size_t limit, size_t mem_size, IOThread *io) {
+    using Record = typename Aggregate::Record;
+    using Reader = BasicRunReader<Record>;
+
+    size_t buffer_size = mem_size / (runs.size() + 1);
+    std::vector<std::unique_ptr<Reader>> readers;
+    std::vector<Reader *> inputs;
+    for (auto &run : runs) {
+        readers.push_back(std::make_unique<Reader>(*run.file, run.offset, run.num_values,
+                                                   buffer_size, spill.io(run.stripe), format,
+                                                   run.size));
+        inputs.push_back(readers.back().get());
+    }
+    BasicLoserTree<Record, typename Aggregate::KeyFn> tree(std::move(inputs));
+
+    BasicRunWriter<Record> writer(output, offset, buffer_size, io, output_format);
+    Combiner<Aggregate> combiner(writer, limit);
+    bool full = false;
+    while (!full && tree.has_next()) {
+        size_t count = 0;
+        const Record *records = tree.batch(count);
+        size_t added = 0;
+        while (added < count && combiner.add(records[added])) {
+            added++;
+        }
+        full = added < count;
+        if (added > 0) {
+            tree.pop(added);
+        }
+    }
+    size_t num_records = combiner.finish();
+    writer.flush();
+    return {num_records, writer.bytes_written()};
+}
+
+/// Sorts the values of `input` and writes one record per distinct value to
+/// `output`. Returns the number of records.
+template <typename Aggregate>
+size_t aggregate_sort(File &input, size_t num_values, File &output, size_t mem_size,
+                      const ExternalSortOptions &options) {
+    using Record = typename Aggregate::Record;
+
+    size_t limit = std::min(options.limit, num_values);
+    output.resize(limit * sizeof(Record));
+    if (limit == 0) {
+        return 0;
+    }
+
+    std::unique_ptr<IOThread> io;
+    if (options.async_io) {
+        io = std::make_unique<IOThread>();
+    }
+
+    // Every thread gets an equal share of the memory and sets aside 1/16 of
+    // it as buffer of the writer of its runs.
+    size_t values_per_chunk = std::max<size_t>(1, mem_size / sizeof(uint64_t));
+    size_t num_threads = std::clamp<size_t>(options.num_threads, 1, values_per_chunk);
+    size_t thread_values = values_per_chunk / num_threads;
+    size_t buffer_size = thread_values / 16 * sizeof(uint64_t);
+    size_t chunk_values = std::max<size_t>(1, thread_values - thread_values / 16);
+    size_t num_chunks = (num_values + chunk_values - 1) / chunk_values;
+
+    // When everything fits in memory, the groups are written to the output
+    // directly.
+    if (num_chunks == 1) {
+        auto values = std::make_unique<uint64_t[]>(num_values);
+        input.read_block(0, num_values * sizeof(uint64_t), reinterpret_cast<char *>(values.get()));
+        radix_sort(values.get(), num_values);
+        BasicRunWriter<Record> writer(output, 0, buffer_size, io.get());
+        size_t num_records = write_groups<Aggregate>(values.get(), num_values, writer, limit);
+        writer.flush();
+        output.resize(num_records * sizeof(Record));
+        return num_records;
+    }
+
+    // Step 1: Sort the chunks and write their groups as runs. Every run gets
+    // a slot that fits the chunk without duplicates.
+    RunFormat format = detail::run_format<Record>(options);
+    detail::SpillArea spill(options.spill_directories, options.async_io);
+    size_t num_stripes = spill.num_stripes();
+    std::vector<Run> runs(num_chunks);
+    {
+        size_t run_stride = format == RunFormat::COMPRESSED ? max_encoded_size(chunk_values)
+                                                            : chunk_values * sizeof(Record);
+        std::vector<std::shared_ptr<File>> run_files;
+        for (size_t stripe = 0; stripe < std::min(num_stripes, num_chunks); stripe++) {
+            run_files.push_back(spill.make_file(stripe));
+            size_t stripe_chunks = (num_chunks - stripe + num_stripes - 1) / num_stripes;
+            run_files.back()->resize(stripe_chunks * run_stride);
+        }
+        std::vector<std::unique_ptr<uint64_t[]>> buffers(num_threads);
+        detail::parallel_for(num_chunks, num_threads, [&](size_t chunk, size_t thread_id) {
+            auto &buffer = buffers[thread_id];
+            if (!buffer) {
+                buffer = std::make_unique<uint64_t[]>(chunk_values);
+            }
+            size_t chunk_start = chunk * chunk_values;
+            size_t chunk_size = std::min(chunk_values, num_values - chunk_start);
+            input.read_block(chunk_start * sizeof(uint64_t), chunk_size * sizeof(uint64_t),
+                             reinterpret_cast<char *>(buffer.get()));
+            radix_sort(buffer.get(), chunk_size);
+
+            size_t stripe = chunk % num_stripes;
+            size_t run_offset = chunk / num_stripes * run_stride;
+            BasicRunWriter<Record> writer(*run_files[stripe], run_offset, buffer_size,
+                                          spill.io(stripe), format);
+            size_t num_records = write_groups<Aggregate>(buffer.get(), chunk_size, writer, limit);
+            writer.flush();
+            runs[chunk] = {run_files[stripe], run_offset, num_records, writer.bytes_written(),
+                           stripe};
+        });
+    }
+
+    // Step 2: Merge the runs in passes, see `external_sort()`. Every merge
+    // combines the groups of its runs again.
+    size_t fan_in = detail::compute_merge_fan_in(runs.size(), io ? mem_size / 2 : mem_size,
+                                                 sizeof(Record));
+    while (runs.size() > fan_in) {
+        size_t num_groups = (runs.size() + fan_in - 1) / fan_in;
+        std::vector<size_t> stripe_records(num_stripes);
+        std::vector<size_t> stripe_groups(num_stripes);
+        for (size_t i = 0; i < runs.size(); i++) {
+            stripe_records[i / fan_in % num_stripes] += runs[i].num_values;
+        }
+        for (size_t i = 0; i < num_groups; i++) {
+            stripe_groups[i % num_stripes]++;
+        }
+        std::vector<std::shared_ptr<File>> pass_files;
+        for (size_t stripe = 0; stripe < std::min(num_stripes, num_groups); stripe++) {
+            pass_files.push_back(spill.make_file(stripe));
+            if (format == RunFormat::COMPRESSED) {
+                pass_files.back()->resize(max_encoded_size(stripe_records[stripe]) +
+                                          stripe_groups[stripe] * CODEC_MAX_BLOCK_SIZE);
+            } else {
+                pass_files.back()->resize(stripe_records[stripe] * sizeof(Record));
+            }
+        }
+
+        std::vector<Run> next_runs;
+        std::vector<size_t> pass_offsets(num_stripes);
+        for (size_t first = 0; first < runs.size(); first += fan_in) {
+            size_t last = std::min(first + fan_in, runs.size());
+            std::vector<Run> group(runs.begin() + first, runs.begin() + last);
+            size_t stripe = first / fan_in % num_stripes;
+            size_t offset = pass_offsets[stripe];
+            MergeResult result =
+                merge_groups<Aggregate>(group, format, spill, *pass_files[stripe], offset, format,
+                                        limit, mem_size, spill.io(stripe));
+            next_runs.push_back(
+                {pass_files[stripe], offset, result.num_records, result.size, stripe});
+            pass_offsets[stripe] += result.size;
+        }
+        runs = std::move(next_runs);
+    }
+    MergeResult result = merge_groups<Aggregate>(runs, format, spill, output, 0, RunFormat::PLAIN,
+                                                 limit, mem_size, io.get());
+    output.resize(result.num_records * sizeof(Record));
+    return result.num_records;
+}
+
+}  // namespace
+
+size_t external_sort_distinct(File &input, size_t num_values, File &output, size_t mem_size,
+                              const ExternalSortOptions &options) {
+    return aggregate_sort<Distinct>(input, num_values, output, mem_size, options);
+}
+
+size_t external_sort_count(File &input, size_t num_values, File &output, size_t mem_size,
+                           const ExternalSortOptions &options) {
+    return aggregate_sort<Count>(input, num_values, output, mem_size, options);
+}
+
+}  // namespace buzzdb
@@ -1,112 +1,160 @@
 #include "external_sort/external_sort.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <functional>
+#include <future>
 #include <iostream>
 #include <map>
-#include <queue>
+#include <mutex>
 #include <thread>
 #include <vector>
 
+#include "common/defer.h"
+#include "external_sort/io_thread.h"
+#include "external_sort/loser_tree.h"
+#include "external_sort/merge_kernel.h"
+#include "external_sort/radix_sort.h"
+#include "external_sort/run_io.h"
 #include "storage/file.h"
 
 #define UNUSED(p) ((void)(p))
 
 namespace buzzdb {
 
-void external_sort(File &input, size_t num_values, File &output, size_t mem_size) {
-    // Calculate how many values we can fit in memory at once
-    size_t values_per_chunk = mem_size / sizeof(uint64_t);
-    size_t num_chunks = (num_values + values_per_chunk - 1) / values_per_chunk;
-    
-    // Vector to store file handles for sorted chunks
-    std::vector<std::unique_ptr<File>> sorted_chunks;
-    
-    // Step 1: Create sorted chunks
-    for (size_t chunk = 0; chunk < num_chunks; chunk++) {
-        // Calculate chunk size
-        size_t chunk_start = chunk * values_per_chunk;
-        size_t chunk_size = std::min(values_per_chunk, num_values - chunk_start);
-        size_t chunk_bytes = chunk_size * sizeof(uint64_t);
-        
-        // Read chunk into memory
-        auto buffer = std::make_unique<uint64_t[]>(chunk_size);
-        input.read_block(chunk_start * sizeof(uint64_t), chunk_bytes, 
-                        reinterpret_cast<char*>(buffer.get()));
-        
-        // Sort the chunk in memory
-        std::sort(buffer.get(), buffer.get() + chunk_size);
-        
-        // Create temporary file for this chunk
-        auto chunk_file = File::make_temporary_file();
-        chunk_file->resize(chunk_bytes);
-        
-        // Write sorted chunk to temporary file
-        chunk_file->write_block(reinterpret_cast<char*>(buffer.get()), 0, chunk_bytes);
-        sorted_chunks.push_back(std::move(chunk_file));
+namespace {
+
+/// The per-request overhead of a read or write, expressed as the number of
+/// bytes that could have been transferred sequentially in the same time.
+/// Used to weigh the number of merge passes against the block size.
+constexpr size_t IO_REQUEST_COST = 64ul << 10;
+
+/// Upper bound for the fan-in of a single merge.
+constexpr size_t MAX_MERGE_FAN_IN = 512;
+
+}  // namespace
+
+namespace detail {
+
+size_t count_merge_passes(size_t num_runs, size_t fan_in) {
+    size_t passes = 0;
+    while (num_runs > 1) {
+        num_runs = (num_runs + fan_in - 1) / fan_in;
+        passes++;
     }
-    
-    // Step 2: K-way merge using priority queue
-    // Structure to keep track of elements in the priority queue
-    struct Element {
-        uint64_t value;
-        size_t chunk_id;
-        size_t position;
-        
-        bool operator>(const Element& other) const {
-            return value > other.value;
+    return passes;
+}
+
+size_t compute_merge_fan_in(size_t num_runs, size_t mem_size, size_t record_size) {
+    size_t max_fan_in = mem_size / record_size;
+    max_fan_in = std::clamp<size_t>(max_fan_in > 0 ? max_fan_in - 1 : 0, 2, MAX_MERGE_FAN_IN);
+    size_t best_fan_in = 2;
+    double best_cost = 0;
+    for (size_t fan_in = 2; fan_in <= max_fan_in; fan_in++) {
+        double block_size = std::max<double>(record_size, mem_size / (fan_in + 1));
+        double cost = count_merge_passes(num_runs, fan_in) * (1.0 + IO_REQUEST_COST / block_size);
+        if (fan_in == 2 || cost < best_cost) {
+            best_fan_in = fan_in;
+            best_cost = cost;
+        }
+    }
+    return best_fan_in;
+}
+
+void parallel_for(size_t num_tasks, size_t num_threads,
+                  const std::function<void(size_t, size_t)> &task) {
+    num_threads = std::clamp<size_t>(num_threads, 1, std::max<size_t>(1, num_tasks));
+    std::atomic<size_t> next_task{0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&](size_t thread_id) {
+        try {
+            for (size_t i = next_task++; i < num_tasks; i = next_task++) {
+                task(i, thread_id);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            // Make the other threads stop early.
+            next_task = num_tasks;
         }
     };
-    
-    // Priority queue for merging
-    std::priority_queue<Element, std::vector<Element>, std::greater<Element>> pq;
-    
-    // Vector to keep track of current position in each chunk
-    std::vector<size_t> chunk_positions(num_chunks, 0);
-    
-    // Initialize priority queue with first element from each chunk
-    for (size_t i = 0; i < num_chunks; i++) {
-        if (i * values_per_chunk < num_values) {
-            uint64_t value;
-            sorted_chunks[i]->read_block(0, sizeof(uint64_t), 
-                                       reinterpret_cast<char*>(&value));
-            pq.push({value, i, 0});
-            chunk_positions[i] = sizeof(uint64_t);
+    std::vector<std::thread> threads;
+    for (size_t thread_id = 1; thread_id < num_threads; thread_id++) {
+        threads.emplace_back(worker, thread_id);
+    }
+    worker(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+SpillArea::SpillArea(const std::vector<std::string> &directories, bool async_io)
+    : directories_(directories) {
+    if (async_io) {
+        for (size_t stripe = 0; stripe < num_stripes(); stripe++) {
+            io_threads_.push_back(std::make_unique<IOThread>());
+        }
+    }
+}
+
+std::shared_ptr<File> SpillArea::make_file(size_t stripe) const {
+    if (directories_.empty()) {
+        return File::make_temporary_file();
+    }
+    return File::make_temporary_file(File::BUFFERED, directories_[stripe].c_str());
+}
+
+void merge_two_runs(RunReader &a, RunReader &b, RunWriter &writer) {
+    while (a.has_next() && b.has_next()) {
+        size_t space = 0;
+        uint64_t *output = writer.reserve(space);
+        size_t size_a = std::min(a.buffered_count(), std::max<size_t>(1, space / 2));
+        size_t size_b = std::min(b.buffered_count(), std::max<size_t>(1, space / 2));
+        if (size_a + size_b > space) {
+            writer.append(a.peek() <= b.peek() ? a.next() : b.next());
+            continue;
+        }
+
+        // Only values up to the smaller of the two last buffered values are
+        // merged, as the values that are not buffered yet may precede the
+        // others.
+        const uint64_t *values_a = a.buffered_values();
+        const uint64_t *values_b = b.buffered_values();
+        if (values_a[size_a - 1] <= values_b[size_b - 1]) {
+            size_b = std::upper_bound(values_b, values_b + size_b, values_a[size_a - 1]) - values_b;
+        } else {
+            size_a = std::upper_bound(values_a, values_a + size_a, values_b[size_b - 1]) - values_a;
         }
+        merge_sorted(values_a, size_a, values_b, size_b, output);
+        writer.commit(size_a + size_b);
+        a.skip(size_a);
+        b.skip(size_b);
     }
-    
-    // Resize output file
-    output.resize(num_values * sizeof(uint64_t));
-    size_t output_position = 0;
-    
-    // Merge chunks
-    while (!pq.empty()) {
-        Element top = pq.top();
-        pq.pop();
-        
-        // Write to output file
-        output.write_block(reinterpret_cast<char*>(&top.value), 
-                          output_position, sizeof(uint64_t));
-        output_position += sizeof(uint64_t);
-        
-        // Calculate how many values are in this chunk
-        size_t chunk_start = top.chunk_id * values_per_chunk;
-        size_t chunk_size = std::min(values_per_chunk, 
-                                   num_values - chunk_start);
-        size_t chunk_bytes = chunk_size * sizeof(uint64_t);
-        
-        // If there are more elements in this chunk, read the next one
-        if (chunk_positions[top.chunk_id] < chunk_bytes) {
-            uint64_t next_value;
-            sorted_chunks[top.chunk_id]->read_block(chunk_positions[top.chunk_id],
-                                                  sizeof(uint64_t),
-                                                  reinterpret_cast<char*>(&next_value));
-            chunk_positions[top.chunk_id] += sizeof(uint64_t);
-            pq.push({next_value, top.chunk_id, chunk_positions[top.chunk_id]});
+    for (RunReader *reader : {&a, &b}) {
+        while (reader->has_next()) {
+            size_t count = reader->buffered_count();
+            writer.append(reader->buffered_values(), count);
+            reader->skip(count);
         }
     }
 }
 
+}  // namespace detail
+
+void external_sort(File &input, size_t num_values, File &output, size_t mem_size,
+                   const ExternalSortOptions &options) {
+    external_sort<uint64_t, IdentityKey>(input, num_values, output, mem_size, options);
+}
+
+template void external_sort<uint64_t, IdentityKey>(File &, size_t, File &, size_t,
+                                                   const ExternalSortOptions &);
+
 }  // namespace buzzdb
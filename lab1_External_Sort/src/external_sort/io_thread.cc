@@ -0,0 +1,54 @@
+#include "external_sort/io_thread.h"
+
+#include <utility>
+
+namespace buzzdb {
+
+IOThread::IOThread() : thread_([this] { run(); }) {}
+
+IOThread::~IOThread() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    requests_changed_.notify_one();
+    thread_.join();
+}
+
+std::future<void> IOThread::submit(std::function<void()> request) {
+    std::packaged_task<void()> task(std::move(request));
+    auto done = task.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        requests_.push_back(std::move(task));
+    }
+    requests_changed_.notify_one();
+    return done;
+}
+
+std::future<void> IOThread::submit(IOThread *io, std::function<void()> request) {
+    if (io != nullptr) {
+        return io->submit(std::move(request));
+    }
+    std::packaged_task<void()> task(std::move(request));
+    task();
+    return task.get_future();
+}
+
+void IOThread::run() {
+    while (true) {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            requests_changed_.wait(lock, [this] { return stopping_ || !requests_.empty(); });
+            if (requests_.empty()) {
+                return;
+            }
+            task = std::move(requests_.front());
+            requests_.pop_front();
+        }
+        task();
+    }
+}
+
+}  // namespace buzzdb
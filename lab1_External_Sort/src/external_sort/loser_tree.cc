@@ -0,0 +1,7 @@
+#include "external_sort/loser_tree.h"
+
+namespace buzzdb {
+
+template class BasicLoserTree<uint64_t, IdentityKey>;
+
+}  // namespace buzzdb
@@ -0,0 +1,274 @@
+#include "external_sort/merge_kernel.h"
+
+#include <cstring>
+#include <utility>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BUZZDB_X86_MERGE_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace buzzdb {
+
+namespace {
+
+/// Branch-free scalar merge. The compiler turns the selection of the next
+/// value into conditional moves, so the merge does not suffer from
+/// mispredictions on random input.
+void merge_scalar(const uint64_t *a, size_t size_a, const uint64_t *b, size_t size_b,
+                  uint64_t *output) {
+    const uint64_t *a_end = a + size_a;
+    const uint64_t *b_end = b + size_b;
+    while (a != a_end && b != b_end) {
+        uint64_t x = *a;
+        uint64_t y = *b;
+        bool take_b = y < x;
+        *output++ = take_b ? y : x;
+        a += !take_b;
+        b += take_b;
+    }
+    std::memcpy(output, a, (a_end - a) * sizeof(uint64_t));
+    output += a_end - a;
+    std::memcpy(output, b, (b_end - b) * sizeof(uint64_t));
+}
+
+/// Finishes a vectorized merge. `carry` holds the `width` largest values
+/// that the merge network has seen so far, and all values that were written
+/// to the output are smaller than or equal to the remaining values of
+/// `carry`, `a` and `b`. At least one of `a` and `b` has fewer than `width`
+/// values left.
+void merge_tail(const uint64_t *carry, size_t width, const uint64_t *a, size_t size_a,
+                const uint64_t *b, size_t size_b, uint64_t *output) {
+    if (size_b < size_a) {
+        std::swap(a, b);
+        std::swap(size_a, size_b);
+    }
+    // Merge the carry with the shorter tail first, so that the final merge
+    // has only two inputs.
+    uint64_t head[16];
+    merge_scalar(carry, width, a, size_a, head);
+    merge_scalar(head, width + size_a, b, size_b, output);
+}
+
+#ifdef BUZZDB_X86_MERGE_KERNELS
+
+#define BUZZDB_AVX2 __attribute__((target("avx2")))
+#define BUZZDB_AVX512 __attribute__((target("avx512f")))
+
+// AVX2 has no unsigned 64 bit comparison, so the AVX2 kernel flips the sign
+// bit of all values when loading and storing them and compares them as
+// signed integers.
+
+BUZZDB_AVX2 inline __m256i load_avx2(const uint64_t *values, __m256i sign) {
+    return _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(values)),
+                            sign);
+}
+
+BUZZDB_AVX2 inline void store_avx2(uint64_t *values, __m256i vector, __m256i sign) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(values), _mm256_xor_si256(vector, sign));
+}
+
+/// Stores the lane-wise minimum of `lo` and `hi` in `lo` and the maximum in
+/// `hi`.
+BUZZDB_AVX2 inline void min_max_avx2(__m256i &lo, __m256i &hi) {
+    __m256i greater = _mm256_cmpgt_epi64(lo, hi);
+    __m256i min = _mm256_blendv_epi8(lo, hi, greater);
+    hi = _mm256_blendv_epi8(hi, lo, greater);
+    lo = min;
+}
+
+/// Sorts a bitonic sequence of 4 values with two half-cleaners.
+BUZZDB_AVX2 inline __m256i sort_bitonic_avx2(__m256i values) {
+    // Compare lanes at distance 2.
+    __m256i lo = values;
+    __m256i hi = _mm256_permute4x64_epi64(values, 0x4E);
+    min_max_avx2(lo, hi);
+    values = _mm256_blend_epi32(lo, hi, 0xF0);
+    // Compare lanes at distance 1.
+    lo = values;
+    hi = _mm256_permute4x64_epi64(values, 0xB1);
+    min_max_avx2(lo, hi);
+    return _mm256_blend_epi32(lo, hi, 0xCC);
+}
+
+/// Merges two sorted vectors. Afterwards, `a` holds the 4 smallest values in
+/// order and `b` the 4 largest ones.
+BUZZDB_AVX2 inline void merge_vectors_avx2(__m256i &a, __m256i &b) {
+    // `a` followed by the reversed `b` is bitonic.
+    b = _mm256_permute4x64_epi64(b, 0x1B);
+    min_max_avx2(a, b);
+    a = sort_bitonic_avx2(a);
+    b = sort_bitonic_avx2(b);
+}
+
+BUZZDB_AVX2 void merge_avx2(const uint64_t *a, size_t size_a, const uint64_t *b,
+                            size_t size_b, uint64_t *output) {
+    constexpr size_t WIDTH = 4;
+    if (size_a < WIDTH || size_b < WIDTH) {
+        merge_scalar(a, size_a, b, size_b, output);
+        return;
+    }
+    const __m256i sign = _mm256_set1_epi64x(static_cast<int64_t>(1ull << 63));
+    const uint64_t *a_end = a + size_a;
+    const uint64_t *b_end = b + size_b;
+    __m256i next = load_avx2(a, sign);
+    __m256i carry = load_avx2(b, sign);
+    a += WIDTH;
+    b += WIDTH;
+    while (static_cast<size_t>(a_end - a) >= WIDTH &&
+           static_cast<size_t>(b_end - b) >= WIDTH) {
+        merge_vectors_avx2(next, carry);
+        store_avx2(output, next, sign);
+        output += WIDTH;
+        // Continue with the block whose first value is smaller. Its values
+        // may belong before the carry, the values of the other block may
+        // not.
+        bool take_a = *a <= *b;
+        next = load_avx2(take_a ? a : b, sign);
+        a += take_a ? WIDTH : 0;
+        b += take_a ? 0 : WIDTH;
+    }
+    merge_vectors_avx2(next, carry);
+    store_avx2(output, next, sign);
+    output += WIDTH;
+
+    uint64_t rest[WIDTH];
+    store_avx2(rest, carry, sign);
+    merge_tail(rest, WIDTH, a, a_end - a, b, b_end - b, output);
+}
+
+// The AVX-512 kernel uses the zero-masking forms of the intrinsics with all
+// lanes enabled. The plain forms start from an undefined vector, which some
+// versions of GCC flag as maybe uninitialized.
+
+BUZZDB_AVX512 inline __m512i min_avx512(__m512i a, __m512i b) {
+    return _mm512_maskz_min_epu64(0xFF, a, b);
+}
+
+BUZZDB_AVX512 inline __m512i max_avx512(__m512i a, __m512i b) {
+    return _mm512_maskz_max_epu64(0xFF, a, b);
+}
+
+BUZZDB_AVX512 inline __m512i permute_avx512(__m512i lanes, __m512i values) {
+    return _mm512_maskz_permutexvar_epi64(0xFF, lanes, values);
+}
+
+/// Sorts a bitonic sequence of 8 values with three half-cleaners.
+BUZZDB_AVX512 inline __m512i sort_bitonic_avx512(__m512i values) {
+    // Compare lanes at distance 4, 2 and 1. The mask selects the lanes that
+    // receive the maximum of a pair.
+    const __m512i distance_4 = _mm512_set_epi64(3, 2, 1, 0, 7, 6, 5, 4);
+    const __m512i distance_2 = _mm512_set_epi64(5, 4, 7, 6, 1, 0, 3, 2);
+    const __m512i distance_1 = _mm512_set_epi64(6, 7, 4, 5, 2, 3, 0, 1);
+    __m512i other = permute_avx512(distance_4, values);
+    values = _mm512_mask_blend_epi64(0xF0, min_avx512(values, other),
+                                     max_avx512(values, other));
+    other = permute_avx512(distance_2, values);
+    values = _mm512_mask_blend_epi64(0xCC, min_avx512(values, other),
+                                     max_avx512(values, other));
+    other = permute_avx512(distance_1, values);
+    return _mm512_mask_blend_epi64(0xAA, min_avx512(values, other),
+                                   max_avx512(values, other));
+}
+
+/// Merges two sorted vectors. Afterwards, `a` holds the 8 smallest values in
+/// order and `b` the 8 largest ones.
+BUZZDB_AVX512 inline void merge_vectors_avx512(__m512i &a, __m512i &b) {
+    // `a` followed by the reversed `b` is bitonic.
+    b = permute_avx512(_mm512_set_epi64(0, 1, 2, 3, 4, 5, 6, 7), b);
+    __m512i min = min_avx512(a, b);
+    b = sort_bitonic_avx512(max_avx512(a, b));
+    a = sort_bitonic_avx512(min);
+}
+
+BUZZDB_AVX512 void merge_avx512(const uint64_t *a, size_t size_a, const uint64_t *b,
+                                size_t size_b, uint64_t *output) {
+    constexpr size_t WIDTH = 8;
+    if (size_a < WIDTH || size_b < WIDTH) {
+        merge_avx2(a, size_a, b, size_b, output);
+        return;
+    }
+    const uint64_t *a_end = a + size_a;
+    const uint64_t *b_end = b + size_b;
+    __m512i next = _mm512_loadu_si512(a);
+    __m512i carry = _mm512_loadu_si512(b);
+    a += WIDTH;
+    b += WIDTH;
+    while (static_cast<size_t>(a_end - a) >= WIDTH &&
+           static_cast<size_t>(b_end - b) >= WIDTH) {
+        merge_vectors_avx512(next, carry);
+        _mm512_storeu_si512(output, next);
+        output += WIDTH;
+        // Continue with the block whose first value is smaller. Its values
+        // may belong before the carry, the values of the other block may
+        // not.
+        bool take_a = *a <= *b;
+        next = _mm512_loadu_si512(take_a ? a : b);
+        a += take_a ? WIDTH : 0;
+        b += take_a ? 0 : WIDTH;
+    }
+    merge_vectors_avx512(next, carry);
+    _mm512_storeu_si512(output, next);
+    output += WIDTH;
+
+    uint64_t rest[WIDTH];
+    _mm512_storeu_si512(rest, carry);
+    merge_tail(rest, WIDTH, a, a_end - a, b, b_end - b, output);
+}
+
+#endif  // BUZZDB_X86_MERGE_KERNELS
+
+}  // namespace
+
+bool is_supported(MergeKernel kernel) {
+    switch (kernel) {
+        case MergeKernel::SCALAR:
+            return true;
+#ifdef BUZZDB_X86_MERGE_KERNELS
+        case MergeKernel::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case MergeKernel::AVX512:
+            // The AVX-512 kernel falls back to the AVX2 kernel for short
+            // inputs.
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+MergeKernel detect_merge_kernel() {
+    static const MergeKernel kernel = [] {
+        for (auto kernel : {MergeKernel::AVX512, MergeKernel::AVX2}) {
+            if (is_supported(kernel)) {
+                return kernel;
+            }
+        }
+        return MergeKernel::SCALAR;
+    }();
+    return kernel;
+}
+
+void merge_sorted(MergeKernel kernel, const uint64_t *a, size_t size_a, const uint64_t *b,
+                  size_t size_b, uint64_t *output) {
+    switch (kernel) {
+#ifdef BUZZDB_X86_MERGE_KERNELS
+        case MergeKernel::AVX2:
+            merge_avx2(a, size_a, b, size_b, output);
+            return;
+        case MergeKernel::AVX512:
+            merge_avx512(a, size_a, b, size_b, output);
+            return;
+#endif
+        default:
+            merge_scalar(a, size_a, b, size_b, output);
+            return;
+    }
+}
+
+void merge_sorted(const uint64_t *a, size_t size_a, const uint64_t *b, size_t size_b,
+                  uint64_t *output) {
+    merge_sorted(detect_merge_kernel(), a, size_a, b, size_b, output);
+}
+
+}  // namespace buzzdb
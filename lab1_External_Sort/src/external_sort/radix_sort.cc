@@ -0,0 +1,164 @@
+#include "external_sort/radix_sort.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <utility>
+
+#include "external_sort/merge_kernel.h"
+
+namespace buzzdb {
+
+namespace {
+
+/// Number of bits per digit.
+constexpr unsigned RADIX_BITS = 8;
+
+/// Number of buckets per pass.
+constexpr size_t RADIX_BUCKETS = 1ul << RADIX_BITS;
+
+/// Number of digits of a 64 bit value.
+constexpr unsigned RADIX_DIGITS = 64 / RADIX_BITS;
+
+/// Size of the blocks that `small_sort()` sorts before merging them.
+constexpr size_t SMALL_SORT_BLOCK = 16;
+
+/// Returns the digit of `value` that starts at bit `shift`.
+inline size_t digit(uint64_t value, unsigned shift) {
+    return (value >> shift) & (RADIX_BUCKETS - 1);
+}
+
+/// LSD radix sort that ping-pongs between `values` and `scratch`. All digit
+/// histograms are computed in a single pass, and passes over digits that are
+/// the same for all values are skipped.
+void lsd_radix_sort(uint64_t *values, size_t num_values, uint64_t *scratch) {
+    std::array<std::array<size_t, RADIX_BUCKETS>, RADIX_DIGITS> histograms{};
+    for (size_t i = 0; i < num_values; i++) {
+        uint64_t value = values[i];
+        for (unsigned d = 0; d < RADIX_DIGITS; d++) {
+            histograms[d][digit(value, d * RADIX_BITS)]++;
+        }
+    }
+
+    uint64_t *from = values;
+    uint64_t *to = scratch;
+    for (unsigned d = 0; d < RADIX_DIGITS; d++) {
+        auto &histogram = histograms[d];
+        unsigned shift = d * RADIX_BITS;
+        if (histogram[digit(from[0], shift)] == num_values) {
+            continue;
+        }
+        std::array<size_t, RADIX_BUCKETS> offsets;
+        size_t offset = 0;
+        for (size_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+            offsets[bucket] = offset;
+            offset += histogram[bucket];
+        }
+        for (size_t i = 0; i < num_values; i++) {
+            uint64_t value = from[i];
+            to[offsets[digit(value, shift)]++] = value;
+        }
+        std::swap(from, to);
+    }
+    if (from != values) {
+        std::memcpy(values, from, num_values * sizeof(uint64_t));
+    }
+}
+
+/// Sorts fewer than `RADIX_SORT_THRESHOLD` values. Blocks of
+/// `SMALL_SORT_BLOCK` values are sorted with `std::sort`, which uses an
+/// insertion sort for them, and are then merged pairwise with the
+/// branch-free `merge_sorted()` through a buffer on the stack.
+void small_sort(uint64_t *values, size_t num_values) {
+    for (size_t begin = 0; begin < num_values; begin += SMALL_SORT_BLOCK) {
+        std::sort(values + begin, values + std::min(num_values, begin + SMALL_SORT_BLOCK));
+    }
+    uint64_t buffer[RADIX_SORT_THRESHOLD];
+    uint64_t *from = values;
+    uint64_t *to = buffer;
+    for (size_t width = SMALL_SORT_BLOCK; width < num_values; width *= 2) {
+        for (size_t begin = 0; begin < num_values; begin += 2 * width) {
+            size_t middle = std::min(num_values, begin + width);
+            size_t end = std::min(num_values, begin + 2 * width);
+            merge_sorted(from + begin, middle - begin, from + middle, end - middle, to + begin);
+        }
+        std::swap(from, to);
+    }
+    if (from != values) {
+        std::memcpy(values, from, num_values * sizeof(uint64_t));
+    }
+}
+
+/// In-place MSD radix sort (American flag sort). Every pass distributes the
+/// values into their buckets by cycling them to their target positions and
+/// then recurses into the buckets with the next lower digit. When a scratch
+/// buffer is given, buckets that fit in the cache are finished with the LSD
+/// radix sort.
+void msd_radix_sort(uint64_t *values, size_t num_values, unsigned shift, uint64_t *scratch) {
+    while (true) {
+        if (num_values < RADIX_SORT_THRESHOLD) {
+            small_sort(values, num_values);
+            return;
+        }
+        if (scratch != nullptr && num_values <= RADIX_SORT_SCRATCH_VALUES) {
+            lsd_radix_sort(values, num_values, scratch);
+            return;
+        }
+
+        std::array<size_t, RADIX_BUCKETS> counts{};
+        for (size_t i = 0; i < num_values; i++) {
+            counts[digit(values[i], shift)]++;
+        }
+
+        // All values share this digit, continue with the next one without
+        // moving anything.
+        if (counts[digit(values[0], shift)] == num_values) {
+            if (shift == 0) {
+                return;
+            }
+            shift -= RADIX_BITS;
+            continue;
+        }
+
+        std::array<size_t, RADIX_BUCKETS> heads;
+        std::array<size_t, RADIX_BUCKETS> tails;
+        size_t offset = 0;
+        for (size_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+            heads[bucket] = offset;
+            offset += counts[bucket];
+            tails[bucket] = offset;
+        }
+
+        for (size_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+            while (heads[bucket] < tails[bucket]) {
+                uint64_t value = values[heads[bucket]];
+                size_t target = digit(value, shift);
+                while (target != bucket) {
+                    std::swap(value, values[heads[target]++]);
+                    target = digit(value, shift);
+                }
+                values[heads[bucket]++] = value;
+            }
+        }
+
+        if (shift == 0) {
+            return;
+        }
+        size_t begin = 0;
+        for (size_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+            if (counts[bucket] > 1) {
+                msd_radix_sort(values + begin, counts[bucket], shift - RADIX_BITS, scratch);
+            }
+            begin += counts[bucket];
+        }
+        return;
+    }
+}
+
+}  // namespace
+
+void radix_sort(uint64_t *values, size_t num_values, uint64_t *scratch) {
+    msd_radix_sort(values, num_values, (RADIX_DIGITS - 1) * RADIX_BITS, scratch);
+}
+
+}  // namespace buzzdb
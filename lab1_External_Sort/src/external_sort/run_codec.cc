@@ -0,0 +1,307 @@
+#include "external_sort/run_codec.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BUZZDB_X86_CODEC_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace buzzdb {
+
+namespace {
+
+/// Number of lanes the differences of a block are distributed over.
+constexpr size_t LANES = 4;
+
+/// The header of a block.
+struct BlockHeader {
+    /// The first value of the block.
+    uint64_t base;
+    /// The number of values in the block.
+    uint32_t num_values;
+    /// The number of bits of every packed difference.
+    uint32_t width;
+};
+
+static_assert(sizeof(BlockHeader) == CODEC_HEADER_SIZE);
+
+/// Returns the number of values per lane of a block with `num_values`
+/// values. Lanes are padded with zero differences.
+size_t lane_values(size_t num_values) {
+    return (num_values + LANES - 1) / LANES;
+}
+
+/// Returns the size of the packed differences of a block in bytes.
+size_t packed_size(size_t num_values, unsigned width) {
+    return (lane_values(num_values) * width + 63) / 64 * LANES * sizeof(uint64_t);
+}
+
+/// Returns the number of bits that are needed to store all differences,
+/// given all of them or'ed together.
+unsigned bit_width(uint64_t bits) {
+    return bits == 0 ? 0 : 64 - __builtin_clzll(bits);
+}
+
+/// Returns a mask of the lowest `width` bits.
+uint64_t low_bits(unsigned width) {
+    return width == 64 ? ~0ull : (1ull << width) - 1;
+}
+
+size_t encode_scalar(const uint64_t *values, size_t num_values, char *output) {
+    uint64_t deltas[CODEC_BLOCK_VALUES];
+    deltas[0] = 0;
+    uint64_t bits = 0;
+    size_t i = 1;
+    for (; i < num_values; i++) {
+        deltas[i] = values[i] - values[i - 1];
+        bits |= deltas[i];
+    }
+    for (; i % LANES != 0; i++) {
+        deltas[i] = 0;
+    }
+    unsigned width = bit_width(bits);
+    BlockHeader header{values[0], static_cast<uint32_t>(num_values), width};
+    std::memcpy(output, &header, sizeof(header));
+    if (width == 0) {
+        return CODEC_HEADER_SIZE;
+    }
+
+    // Word `k` of lane `l` is stored at `words[k * LANES + l]`. A value that
+    // does not fit into the current word continues in the next one.
+    uint64_t words[CODEC_BLOCK_VALUES];
+    uint64_t word[LANES] = {};
+    unsigned bit = 0;
+    size_t k = 0;
+    for (size_t j = 0; j < lane_values(num_values); j++) {
+        const uint64_t *delta = deltas + j * LANES;
+        for (size_t l = 0; l < LANES; l++) {
+            word[l] |= delta[l] << bit;
+        }
+        if (bit + width >= 64) {
+            for (size_t l = 0; l < LANES; l++) {
+                words[k * LANES + l] = word[l];
+                word[l] = bit == 0 ? 0 : delta[l] >> (64 - bit);
+            }
+            k++;
+            bit = bit + width - 64;
+        } else {
+            bit += width;
+        }
+    }
+    if (bit > 0) {
+        std::memcpy(words + k * LANES, word, sizeof(word));
+    }
+    size_t size = packed_size(num_values, width);
+    std::memcpy(output + CODEC_HEADER_SIZE, words, size);
+    return CODEC_HEADER_SIZE + size;
+}
+
+size_t decode_scalar(const char *block, uint64_t *output) {
+    BlockHeader header;
+    std::memcpy(&header, block, sizeof(header));
+    size_t num_values = header.num_values;
+    unsigned width = header.width;
+    uint64_t deltas[CODEC_BLOCK_VALUES] = {};
+    if (width > 0) {
+        uint64_t words[CODEC_BLOCK_VALUES];
+        std::memcpy(words, block + CODEC_HEADER_SIZE, packed_size(num_values, width));
+        uint64_t mask = low_bits(width);
+        unsigned bit = 0;
+        size_t k = 0;
+        for (size_t j = 0; j < lane_values(num_values); j++) {
+            for (size_t l = 0; l < LANES; l++) {
+                uint64_t delta = words[k * LANES + l] >> bit;
+                if (bit + width > 64) {
+                    delta |= words[(k + 1) * LANES + l] << (64 - bit);
+                }
+                deltas[j * LANES + l] = delta & mask;
+            }
+            bit += width;
+            if (bit >= 64) {
+                bit -= 64;
+                k++;
+            }
+        }
+    }
+    uint64_t value = header.base;
+    for (size_t i = 0; i < num_values; i++) {
+        value += deltas[i];
+        output[i] = value;
+    }
+    return num_values;
+}
+
+#ifdef BUZZDB_X86_CODEC_KERNELS
+
+#define BUZZDB_AVX2 __attribute__((target("avx2")))
+
+BUZZDB_AVX2 inline __m256i shift_left_avx2(__m256i values, unsigned bits) {
+    return _mm256_sll_epi64(values, _mm_cvtsi32_si128(bits));
+}
+
+/// Shifts every lane right by `bits`, which may be 64.
+BUZZDB_AVX2 inline __m256i shift_right_avx2(__m256i values, unsigned bits) {
+    return _mm256_srl_epi64(values, _mm_cvtsi32_si128(bits));
+}
+
+BUZZDB_AVX2 size_t encode_avx2(const uint64_t *values, size_t num_values, char *output) {
+    alignas(32) uint64_t deltas[CODEC_BLOCK_VALUES];
+    deltas[0] = 0;
+    __m256i vector_bits = _mm256_setzero_si256();
+    size_t i = 1;
+    for (; i + LANES <= num_values; i += LANES) {
+        __m256i current = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+        __m256i previous =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i - 1));
+        __m256i delta = _mm256_sub_epi64(current, previous);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(deltas + i), delta);
+        vector_bits = _mm256_or_si256(vector_bits, delta);
+    }
+    uint64_t bits = 0;
+    for (; i < num_values; i++) {
+        deltas[i] = values[i] - values[i - 1];
+        bits |= deltas[i];
+    }
+    for (; i % LANES != 0; i++) {
+        deltas[i] = 0;
+    }
+    alignas(32) uint64_t lane_bits[LANES];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lane_bits), vector_bits);
+    for (uint64_t lane : lane_bits) {
+        bits |= lane;
+    }
+
+    unsigned width = bit_width(bits);
+    BlockHeader header{values[0], static_cast<uint32_t>(num_values), width};
+    std::memcpy(output, &header, sizeof(header));
+    if (width == 0) {
+        return CODEC_HEADER_SIZE;
+    }
+
+    char *packed = output + CODEC_HEADER_SIZE;
+    __m256i word = _mm256_setzero_si256();
+    unsigned bit = 0;
+    for (size_t j = 0; j < lane_values(num_values); j++) {
+        __m256i delta = _mm256_load_si256(reinterpret_cast<const __m256i *>(deltas + j * LANES));
+        word = _mm256_or_si256(word, shift_left_avx2(delta, bit));
+        if (bit + width >= 64) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(packed), word);
+            packed += sizeof(word);
+            word = shift_right_avx2(delta, 64 - bit);
+            bit = bit + width - 64;
+        } else {
+            bit += width;
+        }
+    }
+    if (bit > 0) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(packed), word);
+        packed += sizeof(word);
+    }
+    return packed - output;
+}
+
+BUZZDB_AVX2 size_t decode_avx2(const char *block, uint64_t *output) {
+    BlockHeader header;
+    std::memcpy(&header, block, sizeof(header));
+    size_t num_values = header.num_values;
+    unsigned width = header.width;
+    __m256i carry = _mm256_set1_epi64x(static_cast<int64_t>(header.base));
+    if (width == 0) {
+        for (size_t j = 0; j < lane_values(num_values); j++) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + j * LANES), carry);
+        }
+        return num_values;
+    }
+
+    const __m256i *packed = reinterpret_cast<const __m256i *>(block + CODEC_HEADER_SIZE);
+    const __m256i mask = _mm256_set1_epi64x(static_cast<int64_t>(low_bits(width)));
+    const __m256i zero = _mm256_setzero_si256();
+    unsigned bit = 0;
+    for (size_t j = 0; j < lane_values(num_values); j++) {
+        __m256i delta = shift_right_avx2(_mm256_loadu_si256(packed), bit);
+        if (bit + width > 64) {
+            delta = _mm256_or_si256(
+                delta, shift_left_avx2(_mm256_loadu_si256(packed + 1), 64 - bit));
+        }
+        delta = _mm256_and_si256(delta, mask);
+        bit += width;
+        if (bit >= 64) {
+            bit -= 64;
+            packed++;
+        }
+
+        // Prefix sum over the 4 differences: add the lanes shifted up by one
+        // and then by two, followed by the last value of the previous vector.
+        delta = _mm256_add_epi64(
+            delta, _mm256_blend_epi32(_mm256_permute4x64_epi64(delta, 0x90), zero, 0x03));
+        delta = _mm256_add_epi64(
+            delta, _mm256_blend_epi32(_mm256_permute4x64_epi64(delta, 0x40), zero, 0x0F));
+        __m256i result = _mm256_add_epi64(delta, carry);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + j * LANES), result);
+        carry = _mm256_permute4x64_epi64(result, 0xFF);
+    }
+    return num_values;
+}
+
+#endif  // BUZZDB_X86_CODEC_KERNELS
+
+}  // namespace
+
+bool is_supported(CodecKernel kernel) {
+    switch (kernel) {
+        case CodecKernel::SCALAR:
+            return true;
+#ifdef BUZZDB_X86_CODEC_KERNELS
+        case CodecKernel::AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+CodecKernel detect_codec_kernel() {
+    static const CodecKernel kernel =
+        is_supported(CodecKernel::AVX2) ? CodecKernel::AVX2 : CodecKernel::SCALAR;
+    return kernel;
+}
+
+size_t encoded_block_size(const char *block) {
+    BlockHeader header;
+    std::memcpy(&header, block, sizeof(header));
+    return CODEC_HEADER_SIZE + packed_size(header.num_values, header.width);
+}
+
+size_t encode_block(CodecKernel kernel, const uint64_t *values, size_t num_values,
+                    char *output) {
+    switch (kernel) {
+#ifdef BUZZDB_X86_CODEC_KERNELS
+        case CodecKernel::AVX2:
+            return encode_avx2(values, num_values, output);
+#endif
+        default:
+            return encode_scalar(values, num_values, output);
+    }
+}
+
+size_t encode_block(const uint64_t *values, size_t num_values, char *output) {
+    return encode_block(detect_codec_kernel(), values, num_values, output);
+}
+
+size_t decode_block(CodecKernel kernel, const char *block, uint64_t *output) {
+    switch (kernel) {
+#ifdef BUZZDB_X86_CODEC_KERNELS
+        case CodecKernel::AVX2:
+            return decode_avx2(block, output);
+#endif
+        default:
+            return decode_scalar(block, output);
+    }
+}
+
+size_t decode_block(const char *block, uint64_t *output) {
+    return decode_block(detect_codec_kernel(), block, output);
+}
+
+}  // namespace buzzdb
@@ -0,0 +1,8 @@
+#include "external_sort/run_io.h"
+
+namespace buzzdb {
+
+template class BasicRunReader<uint64_t>;
+template class BasicRunWriter<uint64_t>;
+
+}  // namespace buzzdb
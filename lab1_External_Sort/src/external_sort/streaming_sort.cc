@@ -0,0 +1,7 @@
+#include "external_sort/streaming_sort.h"
+
+namespace buzzdb {
+
+template class BasicStreamingSorter<uint64_t, IdentityKey>;
+
+}  // namespace buzzdb
@@ -1,11 +1,61 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
 
 namespace buzzdb {
 
 class File;
 
+/// Strategies to form the initial sorted runs of an external sort.
+enum class RunGeneration {
+  /// Fill the memory, sort it and write it out as one run. Every run has the
+  /// size of the memory.
+  SORT,
+  /// Replacement selection with a heap of the size of the memory. Runs are
+  /// about twice the size of the memory on random input, and nearly sorted
+  /// input becomes a single run.
+  REPLACEMENT_SELECTION,
+};
+
+/// Tuning knobs of `external_sort()`.
+struct ExternalSortOptions {
+  /// How the initial sorted runs are formed.
+  RunGeneration run_generation = RunGeneration::SORT;
+  /// Number of threads that form runs in parallel with
+  /// `RunGeneration::SORT`. Every thread gets an equal share of `mem_size`.
+  /// Replacement selection always uses a single thread. Without a `limit`,
+  /// the final merge of uncompressed runs is split into one key range per
+  /// thread as well, and every thread writes its range of the output.
+  size_t num_threads = 1;
+  /// Whether reads and writes are performed by a background thread while
+  /// the runs are sorted and merged. Every buffer is split into two halves,
+  /// one that is being used and one that is being read or written, so runs
+  /// and blocks get half as large for the same `mem_size`.
+  bool async_io = false;
+  /// Whether the temporary runs are stored delta-encoded and bit-packed, see
+  /// `encode_block()`. Sorted runs of dense values become several times
+  /// smaller, which saves I/O at the cost of encoding and decoding them.
+  /// Only runs of 64 bit unsigned integers are compressed; the option is
+  /// ignored for other records. The output is never compressed.
+  bool compress_runs = false;
+  /// Maximum number of records that are written to the output, like the
+  /// LIMIT of a query. Only the `limit` records with the smallest keys are
+  /// sorted, and the output is resized to hold just them. If they fit into
+  /// half of `mem_size`, the input is read once and nothing is spilled.
+  /// Otherwise, runs are truncated to `limit` records, and the `limit`-th key
+  /// of the first run that reaches it prunes the input of all later runs.
+  size_t limit = std::numeric_limits<size_t>::max();
+  /// Directories of the temporary files, e.g., on different devices. Runs
+  /// are striped round-robin over them, and with `async_io`, every directory
+  /// gets its own I/O thread, so that the runs on different devices are
+  /// written and read in parallel. Empty means the current directory.
+  std::vector<std::string> spill_directories;
+};
+
 /// Sorts 64 bit unsigned integers using external sort.
 /// @param[in] input      File that contains 64 bit unsigned integers which are
 ///                       stored as 8-byte little-endian values. This file may
@@ -16,6 +66,59 @@ class File;
 ///                       end. This file must be in `WRITE` mode.
 /// @param[in] mem_size   The maximum amount of main-memory in bytes that
 ///                       should be used for internal sorting.
-void external_sort(File& input, size_t num_values, File& output, size_t mem_size);
+/// @param[in] options    Tuning knobs, see `ExternalSortOptions`.
+void external_sort(File& input, size_t num_values, File& output, size_t mem_size,
+                   const ExternalSortOptions& options = {});
+
+/// A distinct value and the number of its occurrences, as written by
+/// `external_sort_count()`.
+struct ValueCount {
+  uint64_t value;
+  uint64_t count;
+};
+
+/// Sorts 64 bit unsigned integers like `external_sort()` and removes
+/// duplicates, like a DISTINCT. Duplicates are removed as soon as a chunk
+/// is sorted and again whenever runs are merged, so runs of skewed inputs
+/// become shorter than the input. `options.limit` limits the number of
+/// distinct values. Runs are always formed by sorting memory-sized chunks,
+/// `options.run_generation` is ignored.
+/// @return The number of distinct values. The output is resized to hold
+///         exactly them.
+size_t external_sort_distinct(File& input, size_t num_values, File& output, size_t mem_size,
+                              const ExternalSortOptions& options = {});
+
+/// Sorts 64 bit unsigned integers like `external_sort_distinct()`, but
+/// writes a `ValueCount` for every distinct value, like a GROUP BY with a
+/// COUNT. Runs hold `ValueCount`s as well and are never compressed.
+/// `options.limit` limits the number of distinct values.
+/// @return The number of distinct values. The output is resized to hold
+///         exactly their `ValueCount`s.
+size_t external_sort_count(File& input, size_t num_values, File& output, size_t mem_size,
+                           const ExternalSortOptions& options = {});
+
+/// Sorts fixed-width records by key using external sort. Records are stored
+/// back to back in their in-memory representation, and are ordered by the
+/// key that a default-constructed `KeyFn` returns for them. Records with
+/// equal keys may end up in any order. See `check_sort_key()` for the
+/// requirements on records and keys.
+///
+/// Sorting `uint64_t` with `IdentityKey` is the same as the non-template
+/// `external_sort()`. All other records are sorted with `std::sort` by key
+/// instead of a radix sort.
+/// @param[in] input       File that contains the records. This file may be
+///                        in `READ` mode and should not be written to.
+/// @param[in] num_records The number of records that should be sorted from
+///                        the input.
+/// @param[in] output      File that should contain the sorted records in the
+///                        end. This file must be in `WRITE` mode.
+/// @param[in] mem_size    The maximum amount of main-memory in bytes that
+///                        should be used for internal sorting.
+/// @param[in] options     Tuning knobs, see `ExternalSortOptions`.
+template <typename Record, typename KeyFn>
+void external_sort(File& input, size_t num_records, File& output, size_t mem_size,
+                   const ExternalSortOptions& options = {});
 
 }  // namespace buzzdb
+
+#include "external_sort/external_sort_impl.h"
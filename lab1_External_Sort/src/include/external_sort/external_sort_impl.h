@@ -0,0 +1,877 @@
+#pragma once
+
+// Implementation of the `external_sort()` template. Include
+// "external_sort/external_sort.h" instead.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "common/defer.h"
+#include "external_sort/external_sort.h"
+#include "external_sort/io_thread.h"
+#include "external_sort/loser_tree.h"
+#include "external_sort/radix_sort.h"
+#include "external_sort/run_codec.h"
+#include "external_sort/run_io.h"
+#include "external_sort/sort_key.h"
+#include "storage/file.h"
+
+namespace buzzdb {
+
+namespace detail {
+
+/// A sorted run that is stored in a contiguous range of a file.
+struct Run {
+    /// The file that contains the run. Several runs share one file.
+    std::shared_ptr<File> file;
+    /// Byte offset of the first record of the run.
+    size_t offset;
+    /// Number of records in the run.
+    size_t num_values;
+    /// Size of the run in the file in bytes.
+    size_t size;
+    /// The stripe of the spill area that contains the file.
+    size_t stripe;
+};
+
+/// The temporary files of a sort. Files are striped round-robin over the
+/// spill directories. Without spill directories, there is one stripe in the
+/// current directory. With asynchronous I/O, every stripe gets its own
+/// `IOThread`, separate from the one of the input and output, so that the
+/// files on different devices are written and read in parallel.
+class SpillArea {
+ public:
+    /// Constructor.
+    /// @param[in] directories The spill directories.
+    /// @param[in] async_io    Whether the files are read and written by I/O
+    ///                        threads.
+    SpillArea(const std::vector<std::string> &directories, bool async_io);
+
+    /// Returns the number of stripes.
+    size_t num_stripes() const { return std::max<size_t>(1, directories_.size()); }
+
+    /// Creates a temporary file in the directory of `stripe`.
+    std::shared_ptr<File> make_file(size_t stripe) const;
+
+    /// Returns whether the files are read and written by I/O threads.
+    bool async_io() const { return !io_threads_.empty(); }
+
+    /// Returns the thread that reads and writes the files of `stripe`, or
+    /// `nullptr` for synchronous I/O.
+    IOThread *io(size_t stripe) const {
+        return io_threads_.empty() ? nullptr : io_threads_[stripe].get();
+    }
+
+ private:
+    /// The spill directories.
+    std::vector<std::string> directories_;
+    /// One thread per stripe with asynchronous I/O.
+    std::vector<std::unique_ptr<IOThread>> io_threads_;
+};
+
+/// Returns the number of merge passes needed to merge `num_runs` runs with
+/// the given fan-in.
+size_t count_merge_passes(size_t num_runs, size_t fan_in);
+
+/// Returns the number of runs that are merged at once. Every merge needs one
+/// buffer per input run plus one output buffer, so a larger fan-in saves
+/// passes over the data but makes every read and write smaller. The fan-in
+/// with the lowest estimated I/O cost is chosen. Every buffer holds at least
+/// one record of `record_size` bytes.
+size_t compute_merge_fan_in(size_t num_runs, size_t mem_size, size_t record_size);
+
+/// Calls `task(i, thread_id)` for every `i` in `[0, num_tasks)` using up to
+/// `num_threads` threads, where `thread_id` is in `[0, num_threads)`. Tasks
+/// are handed out in order to whichever thread becomes idle first. The first
+/// exception thrown by a task is rethrown in the calling thread after all
+/// threads have finished.
+void parallel_for(size_t num_tasks, size_t num_threads,
+                  const std::function<void(size_t, size_t)> &task);
+
+/// Merges two runs of 64 bit unsigned integers with `merge_sorted()`, which
+/// is faster than a loser tree for a fan-in of two.
+void merge_two_runs(RunReader &a, RunReader &b, RunWriter &writer);
+
+/// Whether records are sorted with `radix_sort()`, which only handles bare
+/// 64 bit unsigned integers. All other records are sorted by key with
+/// `std::sort`.
+template <typename Record, typename KeyFn>
+constexpr bool USES_RADIX_SORT =
+    std::is_same_v<Record, uint64_t> && std::is_same_v<KeyFn, IdentityKey>;
+
+/// Returns the key of `record`.
+template <typename Record, typename KeyFn>
+uint64_t sort_key(const Record &record) {
+    return KeyFn{}(record);
+}
+
+/// Sorts `records[0, num_records)` by key. `scratch` is the optional radix
+/// sort scratch buffer, see `radix_sort()`.
+template <typename Record, typename KeyFn>
+void sort_records(Record *records, size_t num_records, uint64_t *scratch) {
+    if constexpr (USES_RADIX_SORT<Record, KeyFn>) {
+        radix_sort(records, num_records, scratch);
+    } else {
+        std::sort(records, records + num_records, [](const Record &a, const Record &b) {
+            return sort_key<Record, KeyFn>(a) < sort_key<Record, KeyFn>(b);
+        });
+    }
+}
+
+/// Moves the `limit` records with the smallest keys of `records[0,
+/// num_records)` to the front, in no particular order, and returns the
+/// largest of their keys. `limit` must be in `[1, num_records]`.
+template <typename Record, typename KeyFn>
+uint64_t select_smallest(Record *records, size_t num_records, size_t limit) {
+    std::nth_element(records, records + limit - 1, records + num_records,
+                     [](const Record &a, const Record &b) {
+                         return sort_key<Record, KeyFn>(a) < sort_key<Record, KeyFn>(b);
+                     });
+    return sort_key<Record, KeyFn>(records[limit - 1]);
+}
+
+/// Removes the records with keys larger than `bound` from `records[0,
+/// num_records)` and returns the number of remaining records.
+template <typename Record, typename KeyFn>
+size_t drop_larger_keys(Record *records, size_t num_records, uint64_t bound) {
+    if (bound == std::numeric_limits<uint64_t>::max()) {
+        return num_records;
+    }
+    return std::remove_if(records, records + num_records,
+                          [bound](const Record &record) {
+                              return sort_key<Record, KeyFn>(record) > bound;
+                          }) -
+           records;
+}
+
+/// Returns the number of records of the sorted `records[0, num_records)`
+/// that are kept in a run, which is at most `limit`. If the run reaches the
+/// limit, lowers `bound` to its largest key, as records with larger keys
+/// cannot be among the `limit` smallest ones anymore.
+template <typename Record, typename KeyFn>
+size_t truncate_run(const Record *records, size_t num_records, size_t limit,
+                    std::atomic<uint64_t> &bound) {
+    if (num_records < limit) {
+        return num_records;
+    }
+    uint64_t key = sort_key<Record, KeyFn>(records[limit - 1]);
+    uint64_t current = bound.load();
+    while (key < current && !bound.compare_exchange_weak(current, key)) {
+    }
+    return limit;
+}
+
+/// Returns the number of values of the radix sort scratch buffer for a
+/// memory share of `num_records` records. Unless the share is tiny, a small
+/// part of it is set aside as scratch buffer.
+template <typename Record, typename KeyFn>
+size_t radix_scratch_values(size_t num_records) {
+    if constexpr (USES_RADIX_SORT<Record, KeyFn>) {
+        return num_records >= 4 * RADIX_SORT_SCRATCH_VALUES ? RADIX_SORT_SCRATCH_VALUES : 0;
+    } else {
+        return 0;
+    }
+}
+
+/// Returns the format of the temporary runs of a sort of `Record`s. Only
+/// runs of 64 bit unsigned integers are compressed.
+template <typename Record>
+RunFormat run_format(const ExternalSortOptions &options) {
+    return options.compress_runs && std::is_same_v<Record, uint64_t> ? RunFormat::COMPRESSED
+                                                                      : RunFormat::PLAIN;
+}
+
+/// Writes the sorted `records[0, num_records)` as a compressed run to `file`
+/// starting at `offset`, using `buffer_size` bytes for the encoded blocks.
+/// Returns the size of the run in bytes.
+template <typename Record>
+size_t write_compressed_run(File &file, size_t offset, const Record *records,
+                            size_t num_records, size_t buffer_size, IOThread *io) {
+    BasicRunWriter<Record> writer(file, offset, buffer_size, io, RunFormat::COMPRESSED);
+    writer.append(records, num_records);
+    writer.flush();
+    return writer.bytes_written();
+}
+
+/// Merges `runs`, which are stored in `format` in `spill`, and writes the
+/// first `limit` records of the result to `output` in `output_format`
+/// starting at `offset`. Returns the number of bytes that were written. With
+/// asynchronous I/O, the runs are prefetched by the threads of their stripes
+/// and the output is written by `io` in the background.
+template <typename Record, typename KeyFn>
+size_t merge_runs(const std::vector<Run> &runs, RunFormat format, const SpillArea &spill,
+                  File &output, size_t offset, RunFormat output_format, size_t limit,
+                  size_t mem_size, IOThread *io) {
+    using Reader = BasicRunReader<Record>;
+
+    // The memory budget is split evenly into one input buffer per run and
+    // one output buffer, so that every run is read and the output is
+    // written in large blocks.
+    size_t buffer_size = mem_size / (runs.size() + 1);
+    std::vector<std::unique_ptr<Reader>> readers;
+    readers.reserve(runs.size());
+    size_t num_values = 0;
+    for (auto &run : runs) {
+        num_values += run.num_values;
+        readers.push_back(std::make_unique<Reader>(*run.file, run.offset, run.num_values,
+                                                   buffer_size, spill.io(run.stripe), format,
+                                                   run.size));
+    }
+
+    BasicRunWriter<Record> writer(output, offset, buffer_size, io, output_format);
+    if constexpr (USES_RADIX_SORT<Record, KeyFn>) {
+        if (readers.size() == 2 && limit >= num_values) {
+            merge_two_runs(*readers[0], *readers[1], writer);
+            writer.flush();
+            return writer.bytes_written();
+        }
+    }
+
+    std::vector<Reader*> inputs;
+    for (auto &reader : readers) {
+        inputs.push_back(reader.get());
+    }
+    BasicLoserTree<Record, KeyFn> tree(std::move(inputs));
+    if (limit >= num_values) {
+        tree.merge(writer);
+    } else {
+        while (limit > 0) {
+            size_t count = 0;
+            const Record *values = tree.batch(count);
+            count = std::min(count, limit);
+            writer.append(values, count);
+            tree.pop(count);
+            limit -= count;
+        }
+    }
+    writer.flush();
+    return writer.bytes_written();
+}
+
+/// Restores the min-heap property of `heap[0, size)` after the record at
+/// `position` was replaced by one with a larger key.
+template <typename Record, typename KeyFn>
+void sift_down(Record *heap, size_t size, size_t position) {
+    Record value = heap[position];
+    uint64_t key = sort_key<Record, KeyFn>(value);
+    while (true) {
+        size_t child = 2 * position + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size &&
+            sort_key<Record, KeyFn>(heap[child + 1]) < sort_key<Record, KeyFn>(heap[child])) {
+            child++;
+        }
+        if (key <= sort_key<Record, KeyFn>(heap[child])) {
+            break;
+        }
+        heap[position] = heap[child];
+        position = child;
+    }
+    heap[position] = value;
+}
+
+/// Turns `heap[0, size)` into a min-heap.
+template <typename Record, typename KeyFn>
+void make_heap(Record *heap, size_t size) {
+    for (size_t position = size / 2; position-- > 0;) {
+        sift_down<Record, KeyFn>(heap, size, position);
+    }
+}
+
+/// Forms runs by filling the memory with `values_per_chunk` records, sorting
+/// them and writing them to one file per stripe of `spill`. The chunks are
+/// distributed round-robin over the stripes, and every run starts at the
+/// same multiple of the largest size of a run in the file of its stripe.
+/// With several threads, every thread reads, sorts and
+/// writes its own chunks, so the I/O of one thread overlaps with the sorting
+/// of the others. `thread_values` is the memory share of a single thread in
+/// records. Unless the share is tiny, a small part of it is set aside as
+/// radix sort scratch buffer, and another one as buffer for the encoded
+/// blocks of compressed runs. Runs keep at most `limit` records, see
+/// `truncate_run()`, and records with larger keys than the shared `bound`
+/// are dropped before a chunk is sorted.
+///
+/// With an `IOThread`, every thread splits its share into two chunk buffers
+/// and processes every `num_threads`-th chunk: while one chunk is sorted,
+/// the previous one is written and the next one is read in the background.
+template <typename Record, typename KeyFn>
+std::vector<Run> generate_sorted_runs(File &input, size_t num_values, const SpillArea &spill,
+                                      RunFormat format, size_t limit, size_t thread_values,
+                                      size_t num_threads, IOThread *io) {
+    size_t scratch_values = radix_scratch_values<Record, KeyFn>(thread_values);
+    size_t encode_values = format == RunFormat::COMPRESSED ? thread_values / 16 : 0;
+    size_t encode_buffer_size = encode_values * sizeof(Record);
+    size_t num_buffers = io != nullptr ? 2 : 1;
+    size_t values_per_chunk = std::max<size_t>(
+        1, (thread_values - scratch_values - encode_values) / num_buffers);
+    size_t num_chunks = (num_values + values_per_chunk - 1) / values_per_chunk;
+    size_t run_stride = format == RunFormat::COMPRESSED ? max_encoded_size(values_per_chunk)
+                                                        : values_per_chunk * sizeof(Record);
+    size_t num_stripes = spill.num_stripes();
+    std::vector<std::shared_ptr<File>> run_files;
+    for (size_t stripe = 0; stripe < std::min(num_stripes, num_chunks); stripe++) {
+        run_files.push_back(spill.make_file(stripe));
+        size_t stripe_chunks = (num_chunks - stripe + num_stripes - 1) / num_stripes;
+        run_files.back()->resize(stripe_chunks * run_stride);
+    }
+    std::vector<Run> runs(num_chunks);
+    std::atomic<uint64_t> bound{std::numeric_limits<uint64_t>::max()};
+
+    if (io == nullptr) {
+        // Every thread reuses one chunk buffer and one radix sort scratch
+        // buffer for all of its chunks.
+        std::vector<std::unique_ptr<Record[]>> buffers(std::max<size_t>(1, num_threads));
+        std::vector<std::unique_ptr<uint64_t[]>> scratch_buffers(buffers.size());
+
+        parallel_for(num_chunks, num_threads, [&](size_t chunk, size_t thread_id) {
+            auto &buffer = buffers[thread_id];
+            auto &scratch = scratch_buffers[thread_id];
+            if (!buffer) {
+                buffer = std::make_unique<Record[]>(values_per_chunk);
+                if (scratch_values > 0) {
+                    scratch = std::make_unique<uint64_t[]>(scratch_values);
+                }
+            }
+
+            // Calculate chunk size
+            size_t chunk_start = chunk * values_per_chunk;
+            size_t chunk_size = std::min(values_per_chunk, num_values - chunk_start);
+
+            // Read chunk into memory
+            input.read_block(chunk_start * sizeof(Record), chunk_size * sizeof(Record),
+                             reinterpret_cast<char*>(buffer.get()));
+
+            // Sort the chunk in memory
+            chunk_size = drop_larger_keys<Record, KeyFn>(buffer.get(), chunk_size, bound.load());
+            sort_records<Record, KeyFn>(buffer.get(), chunk_size, scratch.get());
+            chunk_size = truncate_run<Record, KeyFn>(buffer.get(), chunk_size, limit, bound);
+            size_t chunk_bytes = chunk_size * sizeof(Record);
+
+            size_t stripe = chunk % num_stripes;
+            File &run_file = *run_files[stripe];
+            size_t run_offset = chunk / num_stripes * run_stride;
+            if (format == RunFormat::COMPRESSED) {
+                size_t run_size = write_compressed_run(run_file, run_offset, buffer.get(),
+                                                       chunk_size, encode_buffer_size, nullptr);
+                runs[chunk] = {run_files[stripe], run_offset, chunk_size, run_size, stripe};
+                return;
+            }
+            run_file.write_block(reinterpret_cast<char*>(buffer.get()), run_offset, chunk_bytes);
+            runs[chunk] = {run_files[stripe], run_offset, chunk_size, chunk_bytes, stripe};
+        });
+        return runs;
+    }
+
+    num_threads = std::clamp<size_t>(num_threads, 1, num_chunks);
+    parallel_for(num_threads, num_threads, [&](size_t first_chunk, size_t) {
+        std::unique_ptr<Record[]> buffers[2] = {std::make_unique<Record[]>(values_per_chunk),
+                                                std::make_unique<Record[]>(values_per_chunk)};
+        std::unique_ptr<uint64_t[]> scratch;
+        if (scratch_values > 0) {
+            scratch = std::make_unique<uint64_t[]>(scratch_values);
+        }
+        std::future<void> reads[2];
+        std::shared_future<void> writes[2];
+        // The buffers must outlive the requests that use them, also when
+        // one of the requests fails.
+        Defer wait_for_requests([&] {
+            for (size_t i = 0; i < 2; i++) {
+                if (reads[i].valid()) {
+                    reads[i].wait();
+                }
+                if (writes[i].valid()) {
+                    writes[i].wait();
+                }
+            }
+        });
+
+        // Starts reading `chunk` into `buffers[slot]`. The read waits for
+        // the pending write of that buffer, which may be performed by the
+        // thread of another stripe.
+        auto read_chunk = [&](size_t chunk, size_t slot) {
+            size_t offset = chunk * values_per_chunk * sizeof(Record);
+            size_t bytes = std::min(values_per_chunk, num_values - chunk * values_per_chunk) *
+                           sizeof(Record);
+            char *block = reinterpret_cast<char *>(buffers[slot].get());
+            std::shared_future<void> write = writes[slot];
+            reads[slot] = io->submit([&input, offset, bytes, block, write] {
+                if (write.valid()) {
+                    write.wait();
+                }
+                input.read_block(offset, bytes, block);
+            });
+        };
+
+        read_chunk(first_chunk, 0);
+        size_t slot = 0;
+        for (size_t chunk = first_chunk; chunk < num_chunks; chunk += num_threads) {
+            if (writes[slot].valid()) {
+                writes[slot].get();
+            }
+            reads[slot].get();
+            if (chunk + num_threads < num_chunks) {
+                read_chunk(chunk + num_threads, 1 - slot);
+            }
+
+            size_t chunk_start = chunk * values_per_chunk;
+            size_t chunk_size = std::min(values_per_chunk, num_values - chunk_start);
+            Record *buffer = buffers[slot].get();
+            chunk_size = drop_larger_keys<Record, KeyFn>(buffer, chunk_size, bound.load());
+            sort_records<Record, KeyFn>(buffer, chunk_size, scratch.get());
+            chunk_size = truncate_run<Record, KeyFn>(buffer, chunk_size, limit, bound);
+            size_t chunk_bytes = chunk_size * sizeof(Record);
+
+            // A compressed run is encoded while its blocks are written, and
+            // the chunk buffer is free again once the run is complete.
+            size_t stripe = chunk % num_stripes;
+            File &file = *run_files[stripe];
+            size_t run_offset = chunk / num_stripes * run_stride;
+            if (format == RunFormat::COMPRESSED) {
+                size_t run_size = write_compressed_run(file, run_offset, buffer, chunk_size,
+                                                       encode_buffer_size, spill.io(stripe));
+                runs[chunk] = {run_files[stripe], run_offset, chunk_size, run_size, stripe};
+                slot = 1 - slot;
+                continue;
+            }
+            writes[slot] = spill.io(stripe)->submit([&file, buffer, run_offset, chunk_bytes] {
+                file.write_block(reinterpret_cast<const char *>(buffer), run_offset, chunk_bytes);
+            });
+            runs[chunk] = {run_files[stripe], run_offset, chunk_size, chunk_bytes, stripe};
+            slot = 1 - slot;
+        }
+        for (auto &write : writes) {
+            if (write.valid()) {
+                write.get();
+            }
+        }
+    });
+    return runs;
+}
+
+/// Forms runs with replacement selection and writes them back to back to one
+/// file per stripe of `spill`, distributing them round-robin over the
+/// stripes. A min-heap holds the records of the current run. Every record
+/// that is written to the run is replaced by the next input record. If that
+/// record has a smaller key than the one just written, it cannot be part of
+/// the current run and is parked behind the heap for the next run instead.
+/// With an `IOThread`, the input is prefetched and the runs are written in
+/// the background.
+///
+/// Only the first `limit` records of every run are written. Once a run
+/// reaches the limit, input records with larger keys than its last one are
+/// skipped.
+template <typename Record, typename KeyFn>
+std::vector<Run> generate_replacement_selection_runs(File &input, size_t num_values,
+                                                     const SpillArea &spill, RunFormat format,
+                                                     size_t limit, size_t mem_size,
+                                                     IOThread *io) {
+    // A small part of the memory buffers the input and the runs, the rest is
+    // used for the heap.
+    size_t buffer_size = mem_size / 16;
+    size_t capacity = std::max<size_t>(1, (mem_size - 2 * buffer_size) / sizeof(Record));
+    capacity = std::min(capacity, num_values);
+
+    // Every run but the last one has at least `capacity` records, and every
+    // compressed run ends with an incomplete block at most. The runs are not
+    // known in advance, so every file is sized for all of them.
+    size_t file_size = num_values * sizeof(Record);
+    if (format == RunFormat::COMPRESSED) {
+        size_t max_runs = num_values / capacity + 1;
+        file_size = max_encoded_size(num_values) + max_runs * CODEC_MAX_BLOCK_SIZE;
+    }
+    size_t num_stripes = spill.num_stripes();
+    std::vector<std::shared_ptr<File>> run_files;
+    std::vector<size_t> run_offsets(num_stripes);
+    for (size_t stripe = 0; stripe < num_stripes; stripe++) {
+        run_files.push_back(spill.make_file(stripe));
+        run_files.back()->resize(file_size);
+    }
+
+    // Every run gets its own writer, which writes to the file of its stripe.
+    BasicRunReader<Record> reader(input, 0, num_values, buffer_size, io);
+    auto make_writer = [&](size_t stripe) {
+        return std::make_unique<BasicRunWriter<Record>>(
+            *run_files[stripe], run_offsets[stripe], buffer_size, spill.io(stripe), format);
+    };
+    size_t stripe = 0;
+    auto writer = make_writer(stripe);
+    auto heap = std::make_unique<Record[]>(capacity);
+
+    // `heap[0, heap_size)` holds the current run, `heap[heap_size, filled)`
+    // holds the records that were parked for the next run.
+    size_t filled = 0;
+    while (filled < capacity) {
+        heap[filled++] = reader.next();
+    }
+    size_t heap_size = filled;
+    make_heap<Record, KeyFn>(heap.get(), heap_size);
+
+    std::vector<Run> runs;
+    size_t run_size = 0;
+    uint64_t bound = std::numeric_limits<uint64_t>::max();
+    while (filled > 0) {
+        uint64_t key = sort_key<Record, KeyFn>(heap[0]);
+        if (run_size < limit && key <= bound) {
+            writer->append(heap[0]);
+            run_size++;
+            if (run_size == limit) {
+                bound = key;
+            }
+        }
+
+        while (reader.has_next() && sort_key<Record, KeyFn>(reader.peek()) > bound) {
+            reader.skip(1);
+        }
+        if (reader.has_next()) {
+            Record next = reader.next();
+            if (sort_key<Record, KeyFn>(next) >= key) {
+                heap[0] = next;
+            } else {
+                heap_size--;
+                heap[0] = heap[heap_size];
+                heap[heap_size] = next;
+            }
+        } else {
+            // Close the gap between the heap and the parked records.
+            heap_size--;
+            heap[0] = heap[heap_size];
+            heap[heap_size] = heap[filled - 1];
+            filled--;
+        }
+        sift_down<Record, KeyFn>(heap.get(), heap_size, 0);
+
+        if (heap_size == 0) {
+            // The current run is complete, the parked records form the heap
+            // of the next run.
+            writer->flush();
+            size_t size = writer->bytes_written();
+            runs.push_back({run_files[stripe], run_offsets[stripe], run_size, size, stripe});
+            run_offsets[stripe] += size;
+            run_size = 0;
+            stripe = (stripe + 1) % num_stripes;
+            writer.reset();
+            writer = make_writer(stripe);
+            heap_size = filled;
+            make_heap<Record, KeyFn>(heap.get(), heap_size);
+        }
+    }
+    return runs;
+}
+
+/// Merges `runs`, which are stored in `format` in `spill`, in passes until at
+/// most the merge fan-in of them are left, and returns the remaining runs.
+/// Every pass merges groups of up to `fan_in` runs into new temporary files,
+/// one per stripe, and every merged run keeps at most `limit` records. The
+/// merged runs are distributed round-robin over the stripes. A pass keeps at
+/// most two sets of run files open; the files of the previous pass are
+/// closed as soon as no run refers to them anymore.
+template <typename Record, typename KeyFn>
+std::vector<Run> merge_passes(std::vector<Run> runs, RunFormat format, const SpillArea &spill,
+                              size_t limit, size_t mem_size) {
+    // Double buffering halves the block size of every run, which the cost
+    // model sees as half the memory.
+    bool async_io = spill.async_io();
+    size_t fan_in =
+        compute_merge_fan_in(runs.size(), async_io ? mem_size / 2 : mem_size, sizeof(Record));
+    size_t num_stripes = spill.num_stripes();
+    while (runs.size() > fan_in) {
+        // Merge group `i` into the file of stripe `i % num_stripes`.
+        size_t num_groups = (runs.size() + fan_in - 1) / fan_in;
+        std::vector<size_t> stripe_values(num_stripes);
+        std::vector<size_t> stripe_groups(num_stripes);
+        for (size_t i = 0; i < runs.size(); i++) {
+            stripe_values[i / fan_in % num_stripes] += runs[i].num_values;
+        }
+        for (size_t i = 0; i < num_groups; i++) {
+            stripe_groups[i % num_stripes]++;
+        }
+        std::vector<std::shared_ptr<File>> pass_files;
+        for (size_t stripe = 0; stripe < std::min(num_stripes, num_groups); stripe++) {
+            pass_files.push_back(spill.make_file(stripe));
+            if (format == RunFormat::COMPRESSED) {
+                // Every merged run ends with an incomplete block at most.
+                pass_files.back()->resize(max_encoded_size(stripe_values[stripe]) +
+                                          stripe_groups[stripe] * CODEC_MAX_BLOCK_SIZE);
+            } else {
+                pass_files.back()->resize(stripe_values[stripe] * sizeof(Record));
+            }
+        }
+
+        std::vector<Run> next_runs;
+        std::vector<size_t> pass_offsets(num_stripes);
+        for (size_t first = 0; first < runs.size(); first += fan_in) {
+            size_t last = std::min(first + fan_in, runs.size());
+            std::vector<Run> group(runs.begin() + first, runs.begin() + last);
+            size_t group_values = 0;
+            for (auto &run : group) {
+                group_values += run.num_values;
+            }
+            size_t stripe = first / fan_in % num_stripes;
+            size_t offset = pass_offsets[stripe];
+            size_t size =
+                merge_runs<Record, KeyFn>(group, format, spill, *pass_files[stripe], offset,
+                                          format, limit, mem_size, spill.io(stripe));
+            next_runs.push_back(
+                {pass_files[stripe], offset, std::min(group_values, limit), size, stripe});
+            pass_offsets[stripe] += size;
+        }
+        runs = std::move(next_runs);
+    }
+    return runs;
+}
+
+/// Number of keys that are sampled from the runs per partition of
+/// `parallel_merge_runs()`.
+constexpr size_t SAMPLES_PER_PARTITION = 64;
+
+/// Reads the record at `position` of the plain `run`.
+template <typename Record>
+Record read_record(const Run &run, size_t position) {
+    Record record;
+    run.file->read_block(run.offset + position * sizeof(Record), sizeof(Record),
+                         reinterpret_cast<char *>(&record));
+    return record;
+}
+
+/// Returns the position of the first record of the plain `run` whose key is
+/// not smaller than `key`, with a binary search that reads one record per
+/// step.
+template <typename Record, typename KeyFn>
+size_t lower_bound_in_run(const Run &run, uint64_t key) {
+    size_t first = 0;
+    size_t last = run.num_values;
+    while (first < last) {
+        size_t middle = first + (last - first) / 2;
+        if (sort_key<Record, KeyFn>(read_record<Record>(run, middle)) < key) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    return first;
+}
+
+/// Merges the plain `runs` into `output` with `num_threads` threads. The key
+/// range is split into one partition per thread at splitters that are
+/// sampled from the runs, so that the partitions get about the same number
+/// of records. The records of a partition start in every run at the first
+/// record that is not smaller than its splitter, and they start in `output`
+/// behind the records of all previous partitions, so every thread merges
+/// its partition from all runs and writes it concurrently with the others.
+/// Every thread gets an equal share of `mem_size` and reads and writes
+/// synchronously.
+template <typename Record, typename KeyFn>
+void parallel_merge_runs(const std::vector<Run> &runs, File &output, size_t mem_size,
+                         size_t num_threads) {
+    // Sample keys at evenly spaced positions, proportionally to the sizes of
+    // the runs.
+    size_t num_values = 0;
+    for (auto &run : runs) {
+        num_values += run.num_values;
+    }
+    size_t num_samples = SAMPLES_PER_PARTITION * num_threads;
+    std::vector<uint64_t> samples;
+    for (auto &run : runs) {
+        size_t run_samples = std::max<size_t>(1, num_samples * run.num_values / num_values);
+        for (size_t i = 0; i < run_samples; i++) {
+            size_t position = (2 * i + 1) * run.num_values / (2 * run_samples);
+            samples.push_back(sort_key<Record, KeyFn>(read_record<Record>(run, position)));
+        }
+    }
+    std::sort(samples.begin(), samples.end());
+
+    // `starts[p][r]` is the position of the first record of partition `p` in
+    // run `r`. Equal splitters leave partitions empty.
+    std::vector<std::vector<size_t>> starts(num_threads + 1, std::vector<size_t>(runs.size()));
+    for (size_t r = 0; r < runs.size(); r++) {
+        starts[num_threads][r] = runs[r].num_values;
+    }
+    parallel_for(num_threads - 1, num_threads, [&](size_t i, size_t) {
+        uint64_t splitter = samples[(i + 1) * samples.size() / num_threads];
+        for (size_t r = 0; r < runs.size(); r++) {
+            starts[i + 1][r] = lower_bound_in_run<Record, KeyFn>(runs[r], splitter);
+        }
+    });
+
+    // The threads perform their I/O themselves, so the runs are read without
+    // I/O threads.
+    SpillArea synchronous({}, false);
+    parallel_for(num_threads, num_threads, [&](size_t p, size_t) {
+        std::vector<Run> parts;
+        size_t output_offset = 0;
+        for (size_t r = 0; r < runs.size(); r++) {
+            output_offset += starts[p][r] * sizeof(Record);
+            size_t count = starts[p + 1][r] - starts[p][r];
+            if (count > 0) {
+                const Run &run = runs[r];
+                parts.push_back({run.file, run.offset + starts[p][r] * sizeof(Record), count,
+                                 count * sizeof(Record), run.stripe});
+            }
+        }
+        if (!parts.empty()) {
+            merge_runs<Record, KeyFn>(parts, RunFormat::PLAIN, synchronous, output,
+                                      output_offset, RunFormat::PLAIN,
+                                      std::numeric_limits<size_t>::max(),
+                                      mem_size / num_threads, nullptr);
+        }
+    });
+}
+
+/// Writes the `limit` records with the smallest keys of `input` sorted to
+/// `output` in a single pass. The records are collected in a buffer of
+/// `capacity` records, at least twice `limit`. Whenever it is full, only the
+/// `limit` smallest ones are kept, and the largest of their keys becomes the
+/// cutoff: later records with that key or a larger one cannot improve the
+/// result and are not even copied. `buffer_size` is the size of the input
+/// buffer in bytes.
+template <typename Record, typename KeyFn>
+void sort_top_k(File &input, size_t num_values, size_t limit, File &output, size_t buffer_size,
+                size_t capacity, IOThread *io) {
+    auto records = std::make_unique<Record[]>(capacity);
+    BasicRunReader<Record> reader(input, 0, num_values, buffer_size, io);
+    size_t filled = 0;
+    uint64_t cutoff = std::numeric_limits<uint64_t>::max();
+    bool cutoff_known = false;
+    while (reader.has_next()) {
+        const Record *values = reader.buffered_values();
+        size_t count = reader.buffered_count();
+        for (size_t i = 0; i < count; i++) {
+            if (cutoff_known && sort_key<Record, KeyFn>(values[i]) >= cutoff) {
+                continue;
+            }
+            records[filled++] = values[i];
+            if (filled == capacity) {
+                cutoff = select_smallest<Record, KeyFn>(records.get(), filled, limit);
+                cutoff_known = true;
+                filled = limit;
+            }
+        }
+        reader.skip(count);
+    }
+    // At least `limit` records were kept, as the input has more than that.
+    if (filled > limit) {
+        select_smallest<Record, KeyFn>(records.get(), filled, limit);
+    }
+    sort_records<Record, KeyFn>(records.get(), limit, nullptr);
+    output.write_block(reinterpret_cast<char *>(records.get()), 0, limit * sizeof(Record));
+}
+
+}  // namespace detail
+
+template <typename Record, typename KeyFn>
+void external_sort(File &input, size_t num_values, File &output, size_t mem_size,
+                   const ExternalSortOptions &options) {
+    static_assert(check_sort_key<Record, KeyFn>());
+    using detail::Run;
+
+    // Calculate how many records we can fit in memory at once
+    size_t values_per_chunk = std::max<size_t>(1, mem_size / sizeof(Record));
+
+    size_t limit = std::min(options.limit, num_values);
+    output.resize(limit * sizeof(Record));
+    if (limit == 0) {
+        return;
+    }
+
+    // When everything fits in memory, sort it and write it to the output
+    // directly. The radix sort scratch buffer is used only if it fits into
+    // the rest of the memory.
+    if (num_values <= values_per_chunk) {
+        auto buffer = std::make_unique<Record[]>(num_values);
+        input.read_block(0, num_values * sizeof(Record), reinterpret_cast<char*>(buffer.get()));
+        std::unique_ptr<uint64_t[]> scratch;
+        size_t scratch_values = std::min(num_values, RADIX_SORT_SCRATCH_VALUES);
+        if (detail::USES_RADIX_SORT<Record, KeyFn> &&
+            num_values + scratch_values <= values_per_chunk) {
+            scratch = std::make_unique<uint64_t[]>(scratch_values);
+        }
+        if (limit < num_values) {
+            detail::select_smallest<Record, KeyFn>(buffer.get(), num_values, limit);
+        }
+        detail::sort_records<Record, KeyFn>(buffer.get(), limit, scratch.get());
+        output.write_block(reinterpret_cast<char*>(buffer.get()), 0, limit * sizeof(Record));
+        return;
+    }
+
+    // With asynchronous I/O, a background thread performs the reads and
+    // writes of both phases while the calling threads sort and merge.
+    std::unique_ptr<IOThread> io;
+    if (options.async_io) {
+        io = std::make_unique<IOThread>();
+    }
+
+    // When the `limit` smallest records fit into memory twice, select them
+    // in a single pass over the input instead of spilling runs.
+    if (limit < num_values) {
+        size_t buffer_size = mem_size / 16;
+        size_t capacity = (mem_size - buffer_size) / sizeof(Record);
+        if (capacity >= 2 * limit) {
+            detail::sort_top_k<Record, KeyFn>(input, num_values, limit, output, buffer_size,
+                                              capacity, io.get());
+            return;
+        }
+    }
+
+    // Step 1: Create sorted runs. All runs of a stripe are written to a
+    // single temporary file, so the number of open files does not grow with
+    // the number of runs.
+    RunFormat format = detail::run_format<Record>(options);
+    detail::SpillArea spill(options.spill_directories, options.async_io);
+    std::vector<Run> runs;
+    {
+        switch (options.run_generation) {
+            case RunGeneration::SORT: {
+                // Every thread gets an equal share of the memory.
+                size_t num_threads = std::clamp<size_t>(options.num_threads, 1, values_per_chunk);
+                runs = detail::generate_sorted_runs<Record, KeyFn>(
+                    input, num_values, spill, format, limit, values_per_chunk / num_threads,
+                    num_threads, io.get());
+                break;
+            }
+            case RunGeneration::REPLACEMENT_SELECTION:
+                runs = detail::generate_replacement_selection_runs<Record, KeyFn>(
+                    input, num_values, spill, format, limit, mem_size, io.get());
+                break;
+        }
+    }
+    // With a limit, runs may have lost all of their records.
+    runs.erase(std::remove_if(runs.begin(), runs.end(),
+                              [](const Run &run) { return run.num_values == 0; }),
+               runs.end());
+
+    // Step 2: Merge the runs, in passes if there are too many of them. With
+    // several threads, the final merge of plain runs without a limit is split
+    // into key ranges, and the fan-in respects the share of every thread.
+    size_t num_threads = std::max<size_t>(1, options.num_threads);
+    bool parallel_merge = num_threads > 1 && format == RunFormat::PLAIN && limit == num_values;
+    size_t merge_mem_size = parallel_merge ? mem_size / num_threads : mem_size;
+    runs = detail::merge_passes<Record, KeyFn>(std::move(runs), format, spill, limit,
+                                               merge_mem_size);
+    if (runs.empty()) {
+        return;
+    }
+    if (parallel_merge) {
+        detail::parallel_merge_runs<Record, KeyFn>(runs, output, mem_size, num_threads);
+    } else {
+        detail::merge_runs<Record, KeyFn>(runs, format, spill, output, 0, RunFormat::PLAIN,
+                                          limit, mem_size, io.get());
+    }
+}
+
+// The sort of 64 bit unsigned integers is compiled once in external_sort.cc.
+extern template void external_sort<uint64_t, IdentityKey>(File &, size_t, File &, size_t,
+                                                          const ExternalSortOptions &);
+
+}  // namespace buzzdb
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace buzzdb {
+
+/// A background thread that performs I/O requests, so that the caller can
+/// keep computing while a block is read or written. Requests are executed
+/// one at a time in the order in which they were submitted. A request may
+/// thus reuse a buffer that an earlier request reads from without waiting
+/// for the earlier request to finish.
+class IOThread {
+ public:
+    /// Constructor. Starts the thread.
+    IOThread();
+
+    /// Destructor. Executes all pending requests and stops the thread.
+    ~IOThread();
+
+    IOThread(const IOThread&) = delete;
+    IOThread& operator=(const IOThread&) = delete;
+
+    /// Queues `request` for execution. The returned future becomes ready
+    /// when the request is done, and rethrows the exception the request
+    /// threw, if any.
+    std::future<void> submit(std::function<void()> request);
+
+    /// Executes `request` on `io`, or right away on the calling thread if
+    /// `io` is `nullptr`.
+    static std::future<void> submit(IOThread* io, std::function<void()> request);
+
+ private:
+    /// The loop of the background thread.
+    void run();
+
+    /// Protects `requests_` and `stopping_`.
+    std::mutex mutex_;
+    /// Signaled when a request is queued or the thread should stop.
+    std::condition_variable requests_changed_;
+    /// The requests that were not started yet.
+    std::deque<std::packaged_task<void()>> requests_;
+    /// Whether the destructor was called.
+    bool stopping_ = false;
+    /// The background thread.
+    std::thread thread_;
+};
+
+}  // namespace buzzdb
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "external_sort/run_io.h"
+#include "external_sort/sort_key.h"
+
+namespace buzzdb {
+
+/// Merges sorted runs with a tournament tree of losers. Every inner node
+/// stores the run that lost the match at that node, so replacing the winner
+/// needs only one pass from its leaf to the root with one comparison per
+/// level, instead of the two sifts of a binary heap.
+///
+/// Records are ordered by the key that `KeyFn` extracts from them, see
+/// `check_sort_key()`. The nodes store the keys, so matches never touch the
+/// records themselves.
+///
+/// Records are handed out in batches: when a run keeps winning, all of its
+/// buffered records up to the smallest key of the other runs are returned
+/// at once.
+template <typename Record, typename KeyFn>
+class BasicLoserTree {
+    static_assert(check_sort_key<Record, KeyFn>());
+
+ public:
+    using Reader = BasicRunReader<Record>;
+    using Writer = BasicRunWriter<Record>;
+
+    /// Constructor. The readers must outlive the tree.
+    explicit BasicLoserTree(std::vector<Reader*> inputs);
+
+    /// Returns true if any run has records left.
+    bool has_next() const { return remaining_ > 0; }
+
+    /// Returns the record with the smallest key of all runs.
+    /// Must only be called when `has_next()` is true.
+    const Record& peek() const { return winner_reader()->peek(); }
+
+    /// Returns a pointer to the next records in merge order. All of them stem
+    /// from the same run. Their number is stored in `count`, which is at
+    /// least one. The records stay valid until the next call to `pop()`.
+    /// Must only be called when `has_next()` is true.
+    const Record* batch(size_t& count) const;
+
+    /// Consumes the first `count` records of the last `batch()`. Consumes one
+    /// record if `batch()` was not called.
+    void pop(size_t count = 1);
+
+    /// Consumes all records and appends them to `writer` in merge order.
+    void merge(Writer& writer);
+
+ private:
+    /// The largest possible key, which exhausted runs have.
+    static constexpr uint64_t MAX_KEY = std::numeric_limits<uint64_t>::max();
+
+    /// Returns the key of `record`.
+    static uint64_t key(const Record& record) { return KeyFn{}(record); }
+
+    /// Returns `a` if `mask` has all bits set and `b` if it has no bits set.
+    static uint64_t select(uint64_t mask, uint64_t a, uint64_t b) {
+        return b ^ ((a ^ b) & mask);
+    }
+
+    /// A match participant: the current smallest key of a run.
+    struct Node {
+        /// The smallest key of the run. Exhausted runs have the largest
+        /// possible key, so that they lose every match.
+        uint64_t key;
+        /// The index of the run.
+        uint64_t input;
+    };
+
+    /// Returns the current smallest key of run `input`.
+    Node load(size_t input) const;
+
+    /// Plays the matches of `node`, which belongs to the last winner, from
+    /// its leaf up to the root.
+    void replay(Node node);
+
+    /// Plays the matches of `winner` in `tree` from its leaf up to the root.
+    /// Returns true if it is still the winner, and stores the smallest key
+    /// of all other runs in `bound` in that case.
+    static bool replay_path(Node* tree, size_t size, Node winner, uint64_t& bound);
+
+    /// Builds the subtree below `node` and returns its winner.
+    Node build(size_t node);
+
+    /// Returns the reader of the winner. Once only the largest possible
+    /// key is left, exhausted runs tie with runs that still have records,
+    /// so any run with records left is returned.
+    Reader* winner_reader() const;
+
+    /// The merged runs, padded to a power of two with `nullptr`.
+    std::vector<Reader*> inputs_;
+    /// `tree_[0]` is the overall winner, `tree_[1, size)` are the losers of
+    /// the inner nodes. The leaf of run `i` is node `size + i`.
+    std::vector<Node> tree_;
+    /// Number of records in all runs that were not consumed yet.
+    size_t remaining_ = 0;
+    /// Whether `bound_` is known for the current winner, i.e., the winner did
+    /// not change in the last `replay()`.
+    bool bound_known_ = false;
+    /// The smallest key of all runs except the winner.
+    uint64_t bound_ = 0;
+};
+
+/// Merges runs of 64 bit unsigned integers.
+using LoserTree = BasicLoserTree<uint64_t, IdentityKey>;
+
+template <typename Record, typename KeyFn>
+inline bool BasicLoserTree<Record, KeyFn>::replay_path(Node* tree, size_t size, Node winner,
+                                                uint64_t& bound) {
+    // While the last winner keeps winning, the losers on its path are the
+    // winners of all other subtrees, so their minimum is the smallest key
+    // of all other runs.
+    // The outcome of a match is unpredictable for random input, so the loop
+    // selects with bit masks instead of branching.
+    bound = MAX_KEY;
+    uint64_t same_winner = ~0ull;
+    for (size_t node = (winner.input + size) / 2; node > 0; node /= 2) {
+        Node other = tree[node];
+        uint64_t swap = -static_cast<uint64_t>(other.key < winner.key);
+        same_winner &= ~swap;
+        bound = select(same_winner, std::min(bound, other.key), bound);
+        tree[node].key = select(swap, winner.key, other.key);
+        tree[node].input = select(swap, winner.input, other.input);
+        winner.key = select(swap, other.key, winner.key);
+        winner.input = select(swap, other.input, winner.input);
+    }
+    tree[0] = winner;
+    return same_winner != 0;
+}
+
+template <typename Record, typename KeyFn>
+BasicLoserTree<Record, KeyFn>::BasicLoserTree(std::vector<Reader*> inputs)
+    : inputs_(std::move(inputs)) {
+    for (Reader* reader : inputs_) {
+        remaining_ += reader->remaining_count();
+    }
+    size_t size = 1;
+    while (size < inputs_.size()) {
+        size *= 2;
+    }
+    inputs_.resize(size, nullptr);
+    tree_.resize(size);
+    tree_[0] = build(1);
+}
+
+template <typename Record, typename KeyFn>
+typename BasicLoserTree<Record, KeyFn>::Node BasicLoserTree<Record, KeyFn>::load(
+    size_t input) const {
+    Reader* reader = inputs_[input];
+    if (reader != nullptr && reader->has_next()) {
+        return {key(reader->peek()), input};
+    }
+    return {MAX_KEY, input};
+}
+
+template <typename Record, typename KeyFn>
+typename BasicLoserTree<Record, KeyFn>::Node BasicLoserTree<Record, KeyFn>::build(
+    size_t node) {
+    size_t size = inputs_.size();
+    if (node >= size) {
+        return load(node - size);
+    }
+    Node left = build(2 * node);
+    Node right = build(2 * node + 1);
+    if (right.key < left.key) {
+        tree_[node] = left;
+        return right;
+    }
+    tree_[node] = right;
+    return left;
+}
+
+template <typename Record, typename KeyFn>
+void BasicLoserTree<Record, KeyFn>::replay(Node winner) {
+    bound_known_ = replay_path(tree_.data(), inputs_.size(), winner, bound_);
+}
+
+template <typename Record, typename KeyFn>
+typename BasicLoserTree<Record, KeyFn>::Reader* BasicLoserTree<Record, KeyFn>::winner_reader()
+    const {
+    Reader* reader = inputs_[tree_[0].input];
+    if (reader != nullptr && reader->has_next()) {
+        return reader;
+    }
+    for (Reader* other : inputs_) {
+        if (other != nullptr && other->has_next()) {
+            return other;
+        }
+    }
+    return nullptr;
+}
+
+template <typename Record, typename KeyFn>
+const Record* BasicLoserTree<Record, KeyFn>::batch(size_t& count) const {
+    const Reader& reader = *winner_reader();
+    const Record* values = reader.buffered_values();
+    size_t available = reader.buffered_count();
+    if (tree_[0].key == MAX_KEY) {
+        // Only the largest possible key is left.
+        count = available;
+    } else if (bound_known_) {
+        count = 1;
+        while (count < available && key(values[count]) <= bound_) {
+            count++;
+        }
+    } else {
+        count = 1;
+    }
+    return values;
+}
+
+template <typename Record, typename KeyFn>
+void BasicLoserTree<Record, KeyFn>::merge(Writer& writer) {
+    // Work on local copies, as the compiler cannot keep the members in
+    // registers across the stores of records into the buffers.
+    Node* tree = tree_.data();
+    size_t size = inputs_.size();
+    size_t remaining = remaining_;
+    bool bound_known = bound_known_;
+    uint64_t bound = bound_;
+    while (remaining > 0) {
+        Node winner = tree[0];
+        if (winner.key == MAX_KEY) {
+            // Only the largest possible key is left, in whichever runs.
+            for (Reader* reader : inputs_) {
+                while (reader != nullptr && reader->has_next()) {
+                    size_t count = reader->buffered_count();
+                    writer.append(reader->buffered_values(), count);
+                    reader->skip(count);
+                    remaining -= count;
+                }
+            }
+            break;
+        }
+
+        Reader& reader = *inputs_[winner.input];
+        if (bound_known) {
+            const Record* values = reader.buffered_values();
+            size_t available = reader.buffered_count();
+            size_t count = 1;
+            while (count < available && key(values[count]) <= bound) {
+                count++;
+            }
+            writer.append(values, count);
+            reader.skip(count);
+            remaining -= count;
+        } else {
+            writer.append(reader.peek());
+            reader.skip(1);
+            remaining--;
+        }
+        winner.key = reader.has_next() ? key(reader.peek()) : MAX_KEY;
+        bound_known = replay_path(tree, size, winner, bound);
+    }
+    remaining_ = remaining;
+    bound_known_ = bound_known;
+    bound_ = bound;
+}
+
+template <typename Record, typename KeyFn>
+void BasicLoserTree<Record, KeyFn>::pop(size_t count) {
+    Reader* reader = winner_reader();
+    reader->skip(count);
+    remaining_ -= count;
+    if (reader == inputs_[tree_[0].input]) {
+        replay(load(tree_[0].input));
+    }
+}
+
+// The loser tree of 64 bit unsigned integers is compiled once in
+// loser_tree.cc.
+extern template class BasicLoserTree<uint64_t, IdentityKey>;
+
+}  // namespace buzzdb
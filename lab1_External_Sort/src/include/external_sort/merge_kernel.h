@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace buzzdb {
+
+/// Implementations of `merge_sorted()`.
+enum class MergeKernel {
+  /// Branch-free scalar merge that runs on every CPU.
+  SCALAR,
+  /// Bitonic merge network over two vectors of 4 values.
+  AVX2,
+  /// Bitonic merge network over two vectors of 8 values.
+  AVX512,
+};
+
+/// Returns the fastest kernel the CPU supports. It is detected once, all
+/// later calls return the same kernel.
+MergeKernel detect_merge_kernel();
+
+/// Returns true if the CPU can execute `kernel`.
+bool is_supported(MergeKernel kernel);
+
+/// Merges two sorted blocks of 64 bit unsigned integers without branching on
+/// the values. Uses the kernel of `detect_merge_kernel()`.
+/// @param[in]  a      The first sorted block.
+/// @param[in]  size_a The number of values in `a`.
+/// @param[in]  b      The second sorted block.
+/// @param[in]  size_b The number of values in `b`.
+/// @param[out] output Memory for the `size_a + size_b` merged values. Must
+///                    not overlap with `a` or `b`.
+void merge_sorted(const uint64_t* a, size_t size_a, const uint64_t* b, size_t size_b,
+                  uint64_t* output);
+
+/// Like `merge_sorted()`, but with the given kernel, which must be
+/// supported.
+void merge_sorted(MergeKernel kernel, const uint64_t* a, size_t size_a, const uint64_t* b,
+                  size_t size_b, uint64_t* output);
+
+}  // namespace buzzdb
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace buzzdb {
+
+/// Inputs (and MSD buckets) with fewer values are sorted by merging small
+/// sorted blocks with `merge_sorted()`.
+constexpr size_t RADIX_SORT_THRESHOLD = 64;
+
+/// Largest number of values that are sorted with the LSD radix sort, and
+/// thus the largest scratch buffer `radix_sort()` ever needs. Beyond that,
+/// values and scratch buffer no longer fit in the L2 cache and every LSD
+/// pass becomes a scattered pass over main memory.
+constexpr size_t RADIX_SORT_SCRATCH_VALUES = 1ul << 15;
+
+/// Sorts 64 bit unsigned integers with a radix sort over 8-bit digits, so
+/// that the 256 counters of a pass stay in the L1 cache. Inputs with fewer
+/// than `RADIX_SORT_THRESHOLD` values are sorted by merging small sorted
+/// blocks.
+/// @param[in,out] values     The values that are sorted in place.
+/// @param[in]     num_values The number of values.
+/// @param[in]     scratch    Optional buffer for at least
+///                           `min(num_values, RADIX_SORT_SCRATCH_VALUES)`
+///                           values. Without one, an in-place MSD radix sort
+///                           is used, so the sort needs no memory besides
+///                           `values`. With a scratch buffer, MSD buckets that
+///                           fit in the cache are finished with a LSD radix
+///                           sort that skips constant digits.
+void radix_sort(uint64_t* values, size_t num_values, uint64_t* scratch = nullptr);
+
+}  // namespace buzzdb
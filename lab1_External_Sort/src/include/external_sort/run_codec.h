@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace buzzdb {
+
+/// How the values of a run are stored in a file.
+enum class RunFormat {
+  /// The values are stored as they are in memory.
+  PLAIN,
+  /// The values are stored in blocks that are delta-encoded and bit-packed,
+  /// see `encode_block()`. Only runs of 64 bit unsigned integers can be
+  /// compressed.
+  COMPRESSED,
+};
+
+/// Implementations of `encode_block()` and `decode_block()`. Both produce
+/// and accept the same format.
+enum class CodecKernel {
+  /// Scalar code that runs on every CPU.
+  SCALAR,
+  /// Packs and unpacks the 4 lanes of a block with AVX2.
+  AVX2,
+};
+
+/// Maximum number of values in a block.
+constexpr size_t CODEC_BLOCK_VALUES = 128;
+
+/// Size of the header of a block in bytes.
+constexpr size_t CODEC_HEADER_SIZE = 16;
+
+/// Maximum size of a block in bytes.
+constexpr size_t CODEC_MAX_BLOCK_SIZE =
+    CODEC_HEADER_SIZE + CODEC_BLOCK_VALUES * sizeof(uint64_t);
+
+/// Returns an upper bound for the size of `num_values` values that are
+/// encoded in blocks of `CODEC_BLOCK_VALUES` values.
+inline size_t max_encoded_size(size_t num_values) {
+  return (num_values + CODEC_BLOCK_VALUES - 1) / CODEC_BLOCK_VALUES * CODEC_MAX_BLOCK_SIZE;
+}
+
+/// Returns the fastest kernel the CPU supports.
+CodecKernel detect_codec_kernel();
+
+/// Returns true if the CPU can execute `kernel`.
+bool is_supported(CodecKernel kernel);
+
+/// Encodes up to `CODEC_BLOCK_VALUES` values as one block. A block stores
+/// the first value and the differences between consecutive values, each
+/// with the number of bits that the largest difference needs. Consecutive
+/// values of a sorted run are close to each other, so the differences need
+/// much fewer than 64 bits. Unsorted values are encoded correctly, but do
+/// not become smaller.
+///
+/// The differences are distributed round-robin over 4 lanes, and every lane
+/// is packed into its own 64 bit words, which are interleaved. All lanes are
+/// thus packed and unpacked with the same shifts, one vector at a time.
+/// @param[in]  values     The values.
+/// @param[in]  num_values The number of values, at least one and at most
+///                        `CODEC_BLOCK_VALUES`.
+/// @param[out] output     Memory for at least `CODEC_MAX_BLOCK_SIZE` bytes.
+/// @return The size of the block in bytes.
+size_t encode_block(const uint64_t* values, size_t num_values, char* output);
+
+/// Like `encode_block()`, but with the given kernel, which must be
+/// supported.
+size_t encode_block(CodecKernel kernel, const uint64_t* values, size_t num_values,
+                    char* output);
+
+/// Returns the size in bytes of the block that starts at `block`. Only
+/// reads the first `CODEC_HEADER_SIZE` bytes.
+size_t encoded_block_size(const char* block);
+
+/// Decodes a block.
+/// @param[in]  block  The block, which may be unaligned.
+/// @param[out] output Memory for at least `CODEC_BLOCK_VALUES` values.
+/// @return The number of values in the block.
+size_t decode_block(const char* block, uint64_t* output);
+
+/// Like `decode_block()`, but with the given kernel, which must be
+/// supported.
+size_t decode_block(CodecKernel kernel, const char* block, uint64_t* output);
+
+}  // namespace buzzdb
@@ -0,0 +1,589 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "external_sort/io_thread.h"
+#include "external_sort/run_codec.h"
+#include "storage/file.h"
+
+namespace buzzdb {
+
+/// Sequentially reads the fixed-width records of a run through an in-memory
+/// block buffer. The underlying file sees one `read_block()` per buffer
+/// refill instead of one per record. If the file provides a view of the run,
+/// e.g., because it is memory-mapped, the records are read from the view
+/// instead and no buffer is allocated.
+///
+/// With an `IOThread`, the buffer is split into two halves: while the records
+/// of one half are consumed, the next block is read into the other half.
+///
+/// A `RunFormat::COMPRESSED` run is read in chunks of encoded blocks in the
+/// same way, and the records are decoded one block at a time into a buffer of
+/// `CODEC_BLOCK_VALUES` records.
+template <typename Record>
+class BasicRunReader {
+    static_assert(std::is_trivially_copyable_v<Record>,
+                  "records are read and written byte by byte");
+
+ public:
+    /// Constructor.
+    /// @param[in] file        File that contains the run.
+    /// @param[in] offset      Byte offset of the first record of the run.
+    /// @param[in] num_values  Number of records in the run.
+    /// @param[in] buffer_size Size of the input buffer in bytes. The buffer
+    ///                        always holds at least one record.
+    /// @param[in] io          Optional thread that prefetches the next block.
+    ///                        Must outlive the reader.
+    /// @param[in] format      Format of the run. Only runs of 64 bit unsigned
+    ///                        integers can be compressed.
+    /// @param[in] size        Size of a compressed run in bytes, as returned by
+    ///                        `BasicRunWriter::bytes_written()`. Ignored for
+    ///                        plain runs.
+    BasicRunReader(File& file, size_t offset, size_t num_values, size_t buffer_size,
+                   IOThread* io = nullptr, RunFormat format = RunFormat::PLAIN,
+                   size_t size = 0);
+
+    /// Destructor. Waits for a pending prefetch.
+    ~BasicRunReader();
+
+    /// Returns true if the run has records that were not consumed yet.
+    bool has_next() const { return position_ < buffered_; }
+
+    /// Returns the next record of the run without consuming it.
+    /// Must only be called when `has_next()` is true.
+    const Record& peek() const { return values_[position_]; }
+
+    /// Consumes and returns the next record of the run.
+    /// Must only be called when `has_next()` is true.
+    Record next() {
+        Record value = values_[position_++];
+        if (position_ == buffered_) {
+            refill();
+        }
+        return value;
+    }
+
+    /// Returns a pointer to the next records of the run that are already
+    /// buffered. There are `buffered_count()` of them, and they stay valid
+    /// until the next call to `next()` or `skip()`.
+    const Record* buffered_values() const { return values_ + position_; }
+
+    /// Returns the number of records that were not consumed yet.
+    size_t remaining_count() const { return buffered_ - position_ + remaining_; }
+
+    /// Returns the number of records that are already buffered.
+    size_t buffered_count() const { return buffered_ - position_; }
+
+    /// Consumes `count` records. `count` must not be larger than
+    /// `buffered_count()`.
+    void skip(size_t count) {
+        position_ += count;
+        if (position_ == buffered_) {
+            refill();
+        }
+    }
+
+ private:
+    /// Makes the next block of the run the buffered records.
+    void refill();
+
+    /// Starts reading the next block of the run into `prefetch_buffer_`.
+    void prefetch();
+
+    /// Sets up reading a compressed run of `size` bytes.
+    void init_compressed(size_t offset, size_t size, size_t buffer_size);
+
+    /// Decodes the next block of a compressed run.
+    void refill_compressed();
+
+    /// Makes the next chunk of a compressed run available after the encoded
+    /// bytes that were not decoded yet.
+    void load_encoded();
+
+    /// Starts reading the next chunk of a compressed run into
+    /// `encoded_prefetch_`.
+    void prefetch_encoded();
+
+    /// The file that contains the run.
+    File& file_;
+    /// The thread that prefetches blocks, or `nullptr`.
+    IOThread* io_;
+    /// Byte offset of the next record that was not requested yet.
+    size_t file_offset_;
+    /// Number of records that are not buffered yet, including the ones that
+    /// are being prefetched.
+    size_t remaining_;
+    /// Capacity of a buffer in records.
+    size_t capacity_;
+    /// Number of records in the buffer.
+    size_t buffered_ = 0;
+    /// Position of the next record in the buffer.
+    size_t position_ = 0;
+    /// The memory of the input buffer and the prefetch buffer.
+    std::unique_ptr<Record[]> buffer_;
+    /// The buffered records, either in `current_buffer_` or in a view of the
+    /// file.
+    const Record* values_ = nullptr;
+    /// The buffer that is being consumed.
+    Record* current_buffer_ = nullptr;
+    /// The buffer that is being prefetched into.
+    Record* prefetch_buffer_ = nullptr;
+    /// Number of records that are being prefetched.
+    size_t prefetched_ = 0;
+    /// Becomes ready when the prefetch is done.
+    std::future<void> prefetch_done_;
+
+    /// The format of the run.
+    RunFormat format_;
+    /// Number of encoded bytes that were not requested yet.
+    size_t encoded_remaining_ = 0;
+    /// Capacity of a chunk buffer in bytes. Every chunk buffer is preceded by
+    /// `CODEC_MAX_BLOCK_SIZE` bytes, which receive the incomplete block at the
+    /// end of the previous chunk.
+    size_t encoded_capacity_ = 0;
+    /// The memory of the chunk buffers.
+    std::unique_ptr<char[]> encoded_buffer_;
+    /// The next encoded block.
+    const char* encoded_ = nullptr;
+    /// The end of the encoded bytes that are available.
+    const char* encoded_end_ = nullptr;
+    /// The chunk buffer that is being decoded.
+    char* encoded_current_ = nullptr;
+    /// The chunk buffer that is being prefetched into.
+    char* encoded_prefetch_ = nullptr;
+};
+
+/// Sequentially writes fixed-width records to a file through an in-memory
+/// block buffer. The underlying file sees one `write_block()` per full buffer
+/// instead of one per record. The file must already be large enough to hold
+/// all records that are appended.
+///
+/// With an `IOThread`, the buffer is split into two halves: while one half
+/// is written to the file, records are appended to the other half.
+///
+/// In `RunFormat::COMPRESSED`, every `CODEC_BLOCK_VALUES` records are encoded
+/// into a block as soon as they are appended, and the buffer collects the
+/// encoded blocks instead.
+template <typename Record>
+class BasicRunWriter {
+    static_assert(std::is_trivially_copyable_v<Record>,
+                  "records are read and written byte by byte");
+
+ public:
+    /// Constructor.
+    /// @param[in] file        File that is written to.
+    /// @param[in] offset      Byte offset at which the first record is written.
+    /// @param[in] buffer_size Size of the output buffer in bytes. The buffer
+    ///                        always holds at least one record.
+    /// @param[in] io          Optional thread that writes full buffers. Must
+    ///                        outlive the writer.
+    /// @param[in] format      Format of the run. Only runs of 64 bit unsigned
+    ///                        integers can be compressed. A compressed run
+    ///                        needs at most `max_encoded_size()` bytes.
+    BasicRunWriter(File& file, size_t offset, size_t buffer_size, IOThread* io = nullptr,
+                   RunFormat format = RunFormat::PLAIN);
+
+    /// Destructor. Waits for a pending write.
+    ~BasicRunWriter();
+
+    /// Appends a record. Writes the buffer to the file when it is full.
+    void append(const Record& value) {
+        values_[buffered_++] = value;
+        if (buffered_ == capacity_) {
+            write();
+        }
+    }
+
+    /// Appends `count` records.
+    void append(const Record* values, size_t count);
+
+    /// Returns a pointer to the free part of the buffer and stores the
+    /// number of records that fit into it in `count`, which is at least one.
+    /// Records that are written there are appended with `commit()`, which
+    /// saves copying them when they are produced in bulk.
+    Record* reserve(size_t& count) {
+        count = capacity_ - buffered_;
+        return values_ + buffered_;
+    }
+
+    /// Appends the first `count` records that were written to the memory
+    /// returned by the last `reserve()`.
+    void commit(size_t count) {
+        buffered_ += count;
+        if (buffered_ == capacity_) {
+            write();
+        }
+    }
+
+    /// Writes all buffered records to the file and waits until they are
+    /// written. Must be called after the last `append()`, as the destructor
+    /// does not flush.
+    void flush();
+
+    /// Returns the number of bytes that were written to the file so far.
+    size_t bytes_written() const { return bytes_written_; }
+
+ private:
+    /// Starts writing the buffered records to the file. In compressed
+    /// format, encodes them instead and writes the encoded blocks once the
+    /// buffer cannot take another block.
+    void write();
+
+    /// Starts writing `bytes` bytes of `block` to the file.
+    void submit(const char* block, size_t bytes);
+
+    /// Starts writing the encoded blocks to the file.
+    void write_encoded();
+
+    /// The file that is written to.
+    File& file_;
+    /// The thread that writes blocks, or `nullptr`.
+    IOThread* io_;
+    /// Byte offset at which the next block is written.
+    size_t file_offset_;
+    /// Number of bytes that were written to the file so far.
+    size_t bytes_written_ = 0;
+    /// Capacity of a buffer in records.
+    size_t capacity_;
+    /// Number of records in the buffer.
+    size_t buffered_ = 0;
+    /// The memory of the output buffer and the buffer that is being written.
+    std::unique_ptr<Record[]> buffer_;
+    /// The buffer that records are appended to.
+    Record* values_;
+    /// Becomes ready when the last write is done.
+    std::future<void> write_done_;
+
+    /// The format of the run.
+    RunFormat format_;
+    /// Capacity of a buffer of encoded blocks in bytes.
+    size_t encoded_capacity_ = 0;
+    /// Number of bytes in the buffer of encoded blocks.
+    size_t encoded_size_ = 0;
+    /// The memory of the buffers of encoded blocks.
+    std::unique_ptr<char[]> encoded_buffer_;
+    /// The buffer that blocks are encoded into.
+    char* encoded_ = nullptr;
+};
+
+/// Reader of runs of 64 bit unsigned integers.
+using RunReader = BasicRunReader<uint64_t>;
+
+/// Writer of runs of 64 bit unsigned integers.
+using RunWriter = BasicRunWriter<uint64_t>;
+
+template <typename Record>
+BasicRunReader<Record>::BasicRunReader(File& file, size_t offset, size_t num_values,
+                                       size_t buffer_size, IOThread* io, RunFormat format,
+                                       size_t size)
+    : file_(file),
+      io_(io),
+      file_offset_(offset),
+      remaining_(num_values),
+      format_(format) {
+    if (format_ == RunFormat::COMPRESSED) {
+        init_compressed(offset, size, buffer_size);
+        return;
+    }
+    size_t bytes = num_values * sizeof(Record);
+    const char* view = num_values > 0 ? file_.view_block(offset, bytes) : nullptr;
+    if (view != nullptr) {
+        file_.advise(File::SEQUENTIAL, offset, bytes);
+        io_ = nullptr;
+        capacity_ = num_values;
+        values_ = reinterpret_cast<const Record*>(view);
+        buffered_ = num_values;
+        remaining_ = 0;
+        return;
+    }
+
+    size_t num_buffers = io_ != nullptr ? 2 : 1;
+    capacity_ = std::max<size_t>(
+        1, std::min(buffer_size / num_buffers / sizeof(Record), num_values));
+    buffer_ = std::make_unique<Record[]>(num_buffers * capacity_);
+    current_buffer_ = buffer_.get();
+    if (io_ != nullptr) {
+        prefetch_buffer_ = current_buffer_ + capacity_;
+        prefetch();
+    }
+    refill();
+}
+
+template <typename Record>
+BasicRunReader<Record>::~BasicRunReader() {
+    if (prefetch_done_.valid()) {
+        prefetch_done_.wait();
+    }
+}
+
+template <typename Record>
+void BasicRunReader<Record>::refill() {
+    if (format_ == RunFormat::COMPRESSED) {
+        refill_compressed();
+        return;
+    }
+    if (io_ == nullptr) {
+        size_t count = std::min(capacity_, remaining_);
+        if (count > 0) {
+            file_.read_block(file_offset_, count * sizeof(Record),
+                             reinterpret_cast<char*>(current_buffer_));
+        }
+        values_ = current_buffer_;
+        file_offset_ += count * sizeof(Record);
+        remaining_ -= count;
+        buffered_ = count;
+        position_ = 0;
+        return;
+    }
+
+    // Switch to the prefetched block and start prefetching the next one
+    // into the buffer that was just consumed.
+    if (prefetched_ > 0) {
+        prefetch_done_.get();
+    }
+    std::swap(current_buffer_, prefetch_buffer_);
+    values_ = current_buffer_;
+    remaining_ -= prefetched_;
+    buffered_ = prefetched_;
+    position_ = 0;
+    prefetch();
+}
+
+template <typename Record>
+void BasicRunReader<Record>::prefetch() {
+    prefetched_ = std::min(capacity_, remaining_);
+    if (prefetched_ == 0) {
+        return;
+    }
+    File& file = file_;
+    size_t offset = file_offset_;
+    size_t bytes = prefetched_ * sizeof(Record);
+    char* block = reinterpret_cast<char*>(prefetch_buffer_);
+    prefetch_done_ = io_->submit([&file, offset, bytes, block] {
+        file.read_block(offset, bytes, block);
+    });
+    file_offset_ += bytes;
+}
+
+template <typename Record>
+void BasicRunReader<Record>::init_compressed(size_t offset, size_t size, size_t buffer_size) {
+    if (!std::is_same_v<Record, uint64_t>) {
+        throw std::invalid_argument("only runs of 64 bit unsigned integers can be compressed");
+    }
+    capacity_ = CODEC_BLOCK_VALUES;
+    buffer_ = std::make_unique<Record[]>(capacity_);
+    current_buffer_ = buffer_.get();
+    values_ = current_buffer_;
+
+    const char* view = size > 0 ? file_.view_block(offset, size) : nullptr;
+    if (view != nullptr) {
+        file_.advise(File::SEQUENTIAL, offset, size);
+        io_ = nullptr;
+        encoded_ = view;
+        encoded_end_ = view + size;
+    } else {
+        // A chunk always holds at least one complete block, so that every
+        // chunk completes the block that the previous one left incomplete.
+        size_t num_buffers = io_ != nullptr ? 2 : 1;
+        encoded_capacity_ =
+            std::min(size, std::max(CODEC_MAX_BLOCK_SIZE, buffer_size / num_buffers));
+        size_t stride = CODEC_MAX_BLOCK_SIZE + encoded_capacity_;
+        encoded_buffer_ = std::make_unique<char[]>(num_buffers * stride);
+        encoded_current_ = encoded_buffer_.get() + CODEC_MAX_BLOCK_SIZE;
+        encoded_ = encoded_current_;
+        encoded_end_ = encoded_current_;
+        encoded_remaining_ = size;
+        if (io_ != nullptr) {
+            encoded_prefetch_ = encoded_current_ + stride;
+            prefetch_encoded();
+        }
+    }
+    refill_compressed();
+}
+
+template <typename Record>
+void BasicRunReader<Record>::refill_compressed() {
+    position_ = 0;
+    buffered_ = 0;
+    if (remaining_ == 0) {
+        return;
+    }
+    if constexpr (std::is_same_v<Record, uint64_t>) {
+        size_t available = encoded_end_ - encoded_;
+        if (available < CODEC_HEADER_SIZE || available < encoded_block_size(encoded_)) {
+            load_encoded();
+        }
+        size_t block_size = encoded_block_size(encoded_);
+        buffered_ = decode_block(encoded_, current_buffer_);
+        encoded_ += block_size;
+        remaining_ -= buffered_;
+    }
+}
+
+template <typename Record>
+void BasicRunReader<Record>::load_encoded() {
+    // The incomplete block is moved in front of the next chunk.
+    size_t leftover = encoded_end_ - encoded_;
+    if (io_ == nullptr) {
+        std::memmove(encoded_current_ - leftover, encoded_, leftover);
+        size_t bytes = std::min(encoded_capacity_, encoded_remaining_);
+        file_.read_block(file_offset_, bytes, encoded_current_);
+        file_offset_ += bytes;
+        encoded_remaining_ -= bytes;
+        encoded_ = encoded_current_ - leftover;
+        encoded_end_ = encoded_current_ + bytes;
+        return;
+    }
+
+    size_t bytes = prefetched_;
+    if (bytes > 0) {
+        prefetch_done_.get();
+    }
+    std::memcpy(encoded_prefetch_ - leftover, encoded_, leftover);
+    std::swap(encoded_current_, encoded_prefetch_);
+    encoded_ = encoded_current_ - leftover;
+    encoded_end_ = encoded_current_ + bytes;
+    prefetch_encoded();
+}
+
+template <typename Record>
+void BasicRunReader<Record>::prefetch_encoded() {
+    prefetched_ = std::min(encoded_capacity_, encoded_remaining_);
+    if (prefetched_ == 0) {
+        return;
+    }
+    File& file = file_;
+    size_t offset = file_offset_;
+    size_t bytes = prefetched_;
+    char* block = encoded_prefetch_;
+    prefetch_done_ = io_->submit([&file, offset, bytes, block] {
+        file.read_block(offset, bytes, block);
+    });
+    file_offset_ += bytes;
+    encoded_remaining_ -= bytes;
+}
+
+template <typename Record>
+BasicRunWriter<Record>::BasicRunWriter(File& file, size_t offset, size_t buffer_size,
+                                       IOThread* io, RunFormat format)
+    : file_(file), io_(io), file_offset_(offset), format_(format) {
+    size_t num_buffers = io_ != nullptr ? 2 : 1;
+    if (format_ == RunFormat::COMPRESSED) {
+        if (!std::is_same_v<Record, uint64_t>) {
+            throw std::invalid_argument(
+                "only runs of 64 bit unsigned integers can be compressed");
+        }
+        // Records are encoded as soon as a block is complete, so only the
+        // encoded blocks are double-buffered.
+        capacity_ = CODEC_BLOCK_VALUES;
+        buffer_ = std::make_unique<Record[]>(capacity_);
+        values_ = buffer_.get();
+        encoded_capacity_ = std::max(CODEC_MAX_BLOCK_SIZE, buffer_size / num_buffers);
+        encoded_buffer_ = std::make_unique<char[]>(num_buffers * encoded_capacity_);
+        encoded_ = encoded_buffer_.get();
+        return;
+    }
+    capacity_ = std::max<size_t>(1, buffer_size / num_buffers / sizeof(Record));
+    buffer_ = std::make_unique<Record[]>(num_buffers * capacity_);
+    values_ = buffer_.get();
+}
+
+template <typename Record>
+BasicRunWriter<Record>::~BasicRunWriter() {
+    if (write_done_.valid()) {
+        write_done_.wait();
+    }
+}
+
+template <typename Record>
+void BasicRunWriter<Record>::append(const Record* values, size_t count) {
+    while (count > 0) {
+        size_t chunk = std::min(count, capacity_ - buffered_);
+        std::memcpy(values_ + buffered_, values, chunk * sizeof(Record));
+        buffered_ += chunk;
+        values += chunk;
+        count -= chunk;
+        if (buffered_ == capacity_) {
+            write();
+        }
+    }
+}
+
+template <typename Record>
+void BasicRunWriter<Record>::write() {
+    if (buffered_ == 0) {
+        return;
+    }
+    if (format_ == RunFormat::COMPRESSED) {
+        if constexpr (std::is_same_v<Record, uint64_t>) {
+            encoded_size_ += encode_block(values_, buffered_, encoded_ + encoded_size_);
+        }
+        buffered_ = 0;
+        if (encoded_capacity_ - encoded_size_ < CODEC_MAX_BLOCK_SIZE) {
+            write_encoded();
+        }
+        return;
+    }
+    submit(reinterpret_cast<const char*>(values_), buffered_ * sizeof(Record));
+    if (io_ != nullptr) {
+        values_ = values_ == buffer_.get() ? buffer_.get() + capacity_ : buffer_.get();
+    }
+    buffered_ = 0;
+}
+
+template <typename Record>
+void BasicRunWriter<Record>::write_encoded() {
+    if (encoded_size_ == 0) {
+        return;
+    }
+    submit(encoded_, encoded_size_);
+    if (io_ != nullptr) {
+        char* first = encoded_buffer_.get();
+        encoded_ = encoded_ == first ? first + encoded_capacity_ : first;
+    }
+    encoded_size_ = 0;
+}
+
+template <typename Record>
+void BasicRunWriter<Record>::submit(const char* block, size_t bytes) {
+    if (io_ == nullptr) {
+        file_.write_block(block, file_offset_, bytes);
+    } else {
+        // The previous write still reads from the other buffer, so it must be
+        // done before records are appended to it.
+        if (write_done_.valid()) {
+            write_done_.get();
+        }
+        File& file = file_;
+        size_t offset = file_offset_;
+        write_done_ = io_->submit([&file, block, offset, bytes] {
+            file.write_block(block, offset, bytes);
+        });
+    }
+    file_offset_ += bytes;
+    bytes_written_ += bytes;
+}
+
+template <typename Record>
+void BasicRunWriter<Record>::flush() {
+    write();
+    write_encoded();
+    if (write_done_.valid()) {
+        write_done_.get();
+    }
+}
+
+// The reader and writer of 64 bit unsigned integers are compiled once in
+// run_io.cc.
+extern template class BasicRunReader<uint64_t>;
+extern template class BasicRunWriter<uint64_t>;
+
+}  // namespace buzzdb
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace buzzdb {
+
+/// Key extractor of records that are bare 64 bit unsigned integers.
+struct IdentityKey {
+  uint64_t operator()(uint64_t value) const { return value; }
+};
+
+/// The key that `KeyFn` extracts from a `Record`.
+template <typename Record, typename KeyFn>
+using SortKey = std::invoke_result_t<const KeyFn&, const Record&>;
+
+/// Checks the requirements of `external_sort()` on records and key
+/// extractors. Keys are normalized, i.e., unsigned integers of at most 64
+/// bits that are compared as integers, so that the merge can work on
+/// `uint64_t` keys and use the largest one as sentinel of exhausted runs.
+/// Signed or composite keys must be mapped to such integers by the
+/// extractor, e.g., by flipping the sign bit.
+template <typename Record, typename KeyFn>
+constexpr bool check_sort_key() {
+  static_assert(std::is_trivially_copyable_v<Record>,
+                "records are read and written byte by byte");
+  static_assert(std::is_default_constructible_v<KeyFn>,
+                "key extractors must be stateless");
+  using Key = SortKey<Record, KeyFn>;
+  static_assert(std::is_integral_v<Key> && std::is_unsigned_v<Key> &&
+                    std::numeric_limits<Key>::digits <= 64,
+                "keys must be unsigned integers of at most 64 bits");
+  return true;
+}
+
+}  // namespace buzzdb
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "external_sort/external_sort.h"
+#include "external_sort/io_thread.h"
+#include "external_sort/loser_tree.h"
+#include "external_sort/run_codec.h"
+#include "external_sort/run_io.h"
+#include "external_sort/sort_key.h"
+#include "storage/file.h"
+
+namespace buzzdb {
+
+/// Sorts a stream of fixed-width records of unknown length by key, e.g.,
+/// from a pipe or from an operator that produces records one at a time.
+/// Records are `push()`ed into a memory-sized buffer. Whenever it is full,
+/// it is sorted and spilled as a run to a temporary file. After `finish()`,
+/// the sorted records are `pull()`ed from a merge of the runs, so the
+/// sorted output is never written to a file. If all records fit into
+/// memory, nothing is spilled and they are pulled from memory.
+///
+/// Of the `ExternalSortOptions`, `async_io`, `compress_runs` and
+/// `spill_directories` apply as in `external_sort()`. Runs are always formed
+/// by sorting the buffer, on the thread that pushes the records, and are
+/// never limited.
+template <typename Record, typename KeyFn>
+class BasicStreamingSorter {
+    static_assert(check_sort_key<Record, KeyFn>());
+
+ public:
+    /// Constructor.
+    /// @param[in] mem_size The maximum amount of main-memory in bytes that
+    ///                     should be used for sorting and merging.
+    /// @param[in] options  Tuning knobs, see above.
+    explicit BasicStreamingSorter(size_t mem_size, const ExternalSortOptions& options = {});
+
+    /// Destructor. Waits for pending writes.
+    ~BasicStreamingSorter();
+
+    /// Adds a record. Must not be called after `finish()`.
+    void push(const Record& record) {
+        if (filled_ == capacity_) {
+            spill();
+        }
+        chunk_[filled_++] = record;
+    }
+
+    /// Adds `count` records. Must not be called after `finish()`.
+    void push(const Record* records, size_t count);
+
+    /// Ends the input. Afterwards, the records can be pulled.
+    void finish();
+
+    /// Returns true if there are records that were not pulled yet. Must only
+    /// be called after `finish()`.
+    bool has_next() const { return tree_ ? tree_->has_next() : position_ < filled_; }
+
+    /// Removes and returns the record with the smallest key. Must only be
+    /// called when `has_next()` is true.
+    Record pull() {
+        if (!tree_) {
+            return chunk_[position_++];
+        }
+        Record record = tree_->peek();
+        tree_->pop();
+        return record;
+    }
+
+    /// Removes up to `count` records with the smallest keys and stores them
+    /// in `records` in order. Returns the number of stored records, which is
+    /// smaller than `count` only at the end of the output.
+    size_t pull(Record* records, size_t count);
+
+ private:
+    using Run = detail::Run;
+
+    /// Sorts the buffered records and writes them as a run.
+    void spill();
+
+    /// Makes sure that `bytes` more bytes fit into the run file of `stripe`.
+    void reserve_run_file(size_t stripe, size_t bytes);
+
+    /// Waits until all runs are written.
+    void wait_for_writes();
+
+    /// The memory budget in bytes.
+    size_t mem_size_;
+    /// The format of the runs.
+    RunFormat format_;
+    /// The temporary files and their threads.
+    std::unique_ptr<detail::SpillArea> spill_;
+    /// Capacity of a buffer in records.
+    size_t capacity_;
+    /// The buffers that records are pushed into. With an `IOThread`, plain
+    /// runs are written from one buffer while the other one is filled.
+    std::unique_ptr<Record[]> buffers_[2];
+    /// The buffer that records are pushed into.
+    Record* chunk_ = nullptr;
+    /// Index of `chunk_` in `buffers_`.
+    size_t slot_ = 0;
+    /// Number of records in `chunk_`.
+    size_t filled_ = 0;
+    /// Number of values of the radix sort scratch buffer.
+    size_t scratch_values_;
+    /// The radix sort scratch buffer, or `nullptr`.
+    std::unique_ptr<uint64_t[]> scratch_;
+    /// Size of the buffer for the encoded blocks of compressed runs in bytes.
+    size_t encode_buffer_size_ = 0;
+    /// Becomes ready when the run that was written from `buffers_[i]` is
+    /// written.
+    std::future<void> writes_[2];
+
+    /// The files of the stripes that the runs are written to back to back.
+    /// The runs are distributed round-robin over the stripes.
+    std::vector<std::shared_ptr<File>> run_files_;
+    /// Sizes of `run_files_` in bytes. Grow by doubling.
+    std::vector<size_t> run_file_capacities_;
+    /// Number of bytes of `run_files_` that hold runs.
+    std::vector<size_t> run_file_sizes_;
+    /// The spilled runs.
+    std::vector<Run> runs_;
+
+    /// Position of the next record in `chunk_` if nothing was spilled.
+    size_t position_ = 0;
+    /// The readers of the runs of the final merge.
+    std::vector<std::unique_ptr<BasicRunReader<Record>>> readers_;
+    /// The final merge, or `nullptr` if nothing was spilled.
+    std::unique_ptr<BasicLoserTree<Record, KeyFn>> tree_;
+};
+
+/// Streaming sorter of 64 bit unsigned integers.
+using StreamingSorter = BasicStreamingSorter<uint64_t, IdentityKey>;
+
+template <typename Record, typename KeyFn>
+BasicStreamingSorter<Record, KeyFn>::BasicStreamingSorter(size_t mem_size,
+                                                          const ExternalSortOptions& options)
+    : mem_size_(mem_size), format_(detail::run_format<Record>(options)) {
+    spill_ = std::make_unique<detail::SpillArea>(options.spill_directories, options.async_io);
+    run_files_.resize(spill_->num_stripes());
+    run_file_capacities_.resize(spill_->num_stripes());
+    run_file_sizes_.resize(spill_->num_stripes());
+    // Compressed runs are written through a `BasicRunWriter`, which
+    // overlaps encoding and writing by itself.
+    size_t num_buffers = spill_->async_io() && format_ == RunFormat::PLAIN ? 2 : 1;
+    size_t values = std::max<size_t>(1, mem_size / sizeof(Record));
+    scratch_values_ = detail::radix_scratch_values<Record, KeyFn>(values);
+    size_t encode_values = format_ == RunFormat::COMPRESSED ? values / 16 : 0;
+    encode_buffer_size_ = encode_values * sizeof(Record);
+    capacity_ = std::max<size_t>(1, (values - scratch_values_ - encode_values) / num_buffers);
+    for (size_t i = 0; i < num_buffers; i++) {
+        buffers_[i] = std::make_unique<Record[]>(capacity_);
+    }
+    chunk_ = buffers_[0].get();
+    if (scratch_values_ > 0) {
+        scratch_ = std::make_unique<uint64_t[]>(scratch_values_);
+    }
+}
+
+template <typename Record, typename KeyFn>
+BasicStreamingSorter<Record, KeyFn>::~BasicStreamingSorter() {
+    for (auto& write : writes_) {
+        if (write.valid()) {
+            write.wait();
+        }
+    }
+}
+
+template <typename Record, typename KeyFn>
+void BasicStreamingSorter<Record, KeyFn>::push(const Record* records, size_t count) {
+    while (count > 0) {
+        if (filled_ == capacity_) {
+            spill();
+        }
+        size_t chunk = std::min(count, capacity_ - filled_);
+        std::memcpy(chunk_ + filled_, records, chunk * sizeof(Record));
+        filled_ += chunk;
+        records += chunk;
+        count -= chunk;
+    }
+}
+
+template <typename Record, typename KeyFn>
+void BasicStreamingSorter<Record, KeyFn>::finish() {
+    if (runs_.empty()) {
+        detail::sort_records<Record, KeyFn>(chunk_, filled_, scratch_.get());
+        return;
+    }
+    if (filled_ > 0) {
+        spill();
+    }
+    wait_for_writes();
+    // The buffers are not needed anymore, the merge gets all the memory.
+    chunk_ = nullptr;
+    filled_ = 0;
+    buffers_[0].reset();
+    buffers_[1].reset();
+    scratch_.reset();
+
+    runs_ = detail::merge_passes<Record, KeyFn>(std::move(runs_), format_, *spill_,
+                                                std::numeric_limits<size_t>::max(), mem_size_);
+    run_files_.clear();
+    size_t buffer_size = mem_size_ / runs_.size();
+    std::vector<BasicRunReader<Record>*> inputs;
+    for (auto& run : runs_) {
+        readers_.push_back(std::make_unique<BasicRunReader<Record>>(
+            *run.file, run.offset, run.num_values, buffer_size, spill_->io(run.stripe), format_,
+            run.size));
+        inputs.push_back(readers_.back().get());
+    }
+    tree_ = std::make_unique<BasicLoserTree<Record, KeyFn>>(std::move(inputs));
+}
+
+template <typename Record, typename KeyFn>
+size_t BasicStreamingSorter<Record, KeyFn>::pull(Record* records, size_t count) {
+    size_t pulled = 0;
+    while (pulled < count && has_next()) {
+        size_t available = 0;
+        if (tree_) {
+            const Record* values = tree_->batch(available);
+            available = std::min(available, count - pulled);
+            std::memcpy(records + pulled, values, available * sizeof(Record));
+            tree_->pop(available);
+        } else {
+            available = std::min(filled_ - position_, count - pulled);
+            std::memcpy(records + pulled, chunk_ + position_, available * sizeof(Record));
+            position_ += available;
+        }
+        pulled += available;
+    }
+    return pulled;
+}
+
+template <typename Record, typename KeyFn>
+void BasicStreamingSorter<Record, KeyFn>::spill() {
+    detail::sort_records<Record, KeyFn>(chunk_, filled_, scratch_.get());
+    size_t stripe = runs_.size() % spill_->num_stripes();
+    size_t offset = run_file_sizes_[stripe];
+    IOThread* io = spill_->io(stripe);
+    if (format_ == RunFormat::COMPRESSED) {
+        reserve_run_file(stripe, max_encoded_size(filled_));
+        size_t size = detail::write_compressed_run(*run_files_[stripe], offset, chunk_, filled_,
+                                                   encode_buffer_size_, io);
+        runs_.push_back({run_files_[stripe], offset, filled_, size, stripe});
+        run_file_sizes_[stripe] += size;
+        filled_ = 0;
+        return;
+    }
+
+    size_t bytes = filled_ * sizeof(Record);
+    reserve_run_file(stripe, bytes);
+    runs_.push_back({run_files_[stripe], offset, filled_, bytes, stripe});
+    run_file_sizes_[stripe] += bytes;
+    filled_ = 0;
+    if (io == nullptr) {
+        run_files_[stripe]->write_block(reinterpret_cast<const char*>(chunk_), offset, bytes);
+        return;
+    }
+
+    // Write the run in the background and continue with the other buffer
+    // once its previous run is written.
+    File& file = *run_files_[stripe];
+    const char* block = reinterpret_cast<const char*>(chunk_);
+    writes_[slot_] = io->submit([&file, block, offset, bytes] {
+        file.write_block(block, offset, bytes);
+    });
+    slot_ = 1 - slot_;
+    chunk_ = buffers_[slot_].get();
+    if (writes_[slot_].valid()) {
+        writes_[slot_].get();
+    }
+}
+
+template <typename Record, typename KeyFn>
+void BasicStreamingSorter<Record, KeyFn>::reserve_run_file(size_t stripe, size_t bytes) {
+    if (!run_files_[stripe]) {
+        run_files_[stripe] = spill_->make_file(stripe);
+    }
+    size_t needed = run_file_sizes_[stripe] + bytes;
+    if (needed <= run_file_capacities_[stripe]) {
+        return;
+    }
+    // The file must not be resized while a run is written to it.
+    wait_for_writes();
+    run_file_capacities_[stripe] = std::max(needed, 2 * run_file_capacities_[stripe]);
+    run_files_[stripe]->resize(run_file_capacities_[stripe]);
+}
+
+template <typename Record, typename KeyFn>
+void BasicStreamingSorter<Record, KeyFn>::wait_for_writes() {
+    for (auto& write : writes_) {
+        if (write.valid()) {
+            write.get();
+        }
+    }
+}
+
+// The streaming sorter of 64 bit unsigned integers is compiled once in
+// streaming_sort.cc.
+extern template class BasicStreamingSorter<uint64_t, IdentityKey>;
+
+}  // namespace buzzdb
@@ -0,0 +1,181 @@
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+
+#include "storage/file.h"
+
+namespace buzzdb {
+
+namespace {
+
+[[noreturn]] void throw_errno() {
+  throw std::system_error{errno, std::system_category()};
+}
+
+}  // namespace
+
+class MmapFile : public File {
+ private:
+  Mode mode;
+  int fd;
+  /// The mapping of the whole file, or `nullptr` if the file is empty.
+  char* mapping = nullptr;
+  size_t cached_size;
+
+  int protection() const {
+    return mode == READ ? PROT_READ : PROT_READ | PROT_WRITE;
+  }
+
+  /// Maps the first `cached_size` bytes of the file.
+  void map() {
+    if (cached_size == 0) {
+      mapping = nullptr;
+      return;
+    }
+    void* address =
+        ::mmap(nullptr, cached_size, protection(), MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+      throw_errno();
+    }
+    mapping = static_cast<char*>(address);
+  }
+
+ public:
+  MmapFile(const char* filename, Mode mode) : mode(mode) {
+    switch (mode) {
+      case READ:
+        fd = ::open(filename, O_RDONLY);
+        break;
+      case WRITE:
+        fd = ::open(filename, O_RDWR | O_CREAT, 0666);
+    }
+    if (fd < 0) {
+      throw_errno();
+    }
+    struct ::stat file_stat;
+    if (::fstat(fd, &file_stat) < 0) {
+      ::close(fd);
+      throw_errno();
+    }
+    cached_size = file_stat.st_size;
+    try {
+      map();
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+  }
+
+  ~MmapFile() override {
+    // Don't check return values here, as we don't want a throwing
+    // destructor.
+    if (mapping != nullptr) {
+      ::munmap(mapping, cached_size);
+    }
+    ::close(fd);
+  }
+
+  Mode get_mode() const override { return mode; }
+
+  size_t size() const override { return cached_size; }
+
+  void resize(size_t new_size) override {
+    if (new_size == cached_size) {
+      return;
+    }
+    if (::ftruncate(fd, new_size) < 0) {
+      throw_errno();
+    }
+    if (mapping == nullptr) {
+      cached_size = new_size;
+      map();
+    } else if (new_size == 0) {
+      ::munmap(mapping, cached_size);
+      mapping = nullptr;
+      cached_size = 0;
+    } else {
+      // The mapping may move, which invalidates all views.
+      void* address =
+          ::mremap(mapping, cached_size, new_size, MREMAP_MAYMOVE);
+      if (address == MAP_FAILED) {
+        throw_errno();
+      }
+      mapping = static_cast<char*>(address);
+      cached_size = new_size;
+    }
+  }
+
+  void read_block(size_t offset, size_t size, char* block) override {
+    // Like a read from a file, reading past the end only returns the bytes
+    // up to the end.
+    if (offset >= cached_size) {
+      return;
+    }
+    std::memcpy(block, mapping + offset, std::min(size, cached_size - offset));
+  }
+
+  void write_block(const char* block, size_t offset, size_t size) override {
+    if (size == 0) {
+      return;
+    }
+    if (offset + size > cached_size) {
+      // The mapping cannot grow on its own.
+      throw std::out_of_range("write past the end of a mapped file");
+    }
+    std::memcpy(mapping + offset, block, size);
+  }
+
+  const char* view_block(size_t offset, size_t size) override {
+    if (size == 0 || offset + size > cached_size) {
+      return nullptr;
+    }
+    return mapping + offset;
+  }
+
+  void advise(Advice advice, size_t offset, size_t size) override {
+    if (mapping == nullptr || offset >= cached_size) {
+      return;
+    }
+    int madvice = MADV_NORMAL;
+    switch (advice) {
+      case NORMAL:
+        break;
+      case SEQUENTIAL:
+        madvice = MADV_SEQUENTIAL;
+        break;
+      case WILLNEED:
+        madvice = MADV_WILLNEED;
+        break;
+    }
+    // madvise() needs a page-aligned start address.
+    size_t page_size = ::sysconf(_SC_PAGESIZE);
+    size_t begin = offset / page_size * page_size;
+    size_t end = std::min(offset + size, cached_size);
+    // Failing to give a hint is not an error.
+    ::madvise(mapping + begin, end - begin, madvice);
+  }
+
+  void sync() override {
+    if (mapping != nullptr && ::msync(mapping, cached_size, MS_SYNC) < 0) {
+      throw_errno();
+    }
+    if (::fdatasync(fd) < 0) {
+      throw_errno();
+    }
+  }
+};
+
+std::unique_ptr<File> File::open_mapped_file(const char* filename, Mode mode) {
+  return std::make_unique<MmapFile>(filename, mode);
+}
+
+}  // namespace buzzdb
@@ -0,0 +1,174 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "external_sort/external_sort.h"
+#include "storage/file.h"
+#include "storage/test_file.h"
+
+namespace {
+
+/// How the input values are distributed.
+enum Distribution {
+  /// Uniformly distributed over the full range.
+  RANDOM,
+  /// Sorted in descending order, the worst case for replacement selection.
+  DESCENDING,
+  /// Sorted, except that every 100th value is random.
+  NEARLY_SORTED,
+  /// Only 1000 distinct values.
+  DUPLICATES,
+};
+
+const char* const DISTRIBUTION_NAMES[] = {"random", "descending", "nearly_sorted", "duplicates"};
+
+/// Where the input and output live. Temporary runs are always written to
+/// files in the current directory.
+enum Backend {
+  /// In memory, so only the temporary runs cause I/O.
+  TEST_FILE,
+  /// Temporary files in the current directory.
+  POSIX_FILE,
+  /// In memory, but every request is delayed like on a SATA SSD.
+  SIMULATED_SSD,
+};
+
+const char* const BACKEND_NAMES[] = {"test_file", "posix_file", "simulated_ssd"};
+
+std::vector<uint64_t> make_values(size_t num_values, Distribution distribution) {
+  std::mt19937_64 engine{42};
+  std::vector<uint64_t> values(num_values);
+  for (size_t i = 0; i < num_values; i++) {
+    switch (distribution) {
+      case RANDOM:
+        values[i] = engine();
+        break;
+      case DESCENDING:
+        values[i] = num_values - i;
+        break;
+      case NEARLY_SORTED:
+        values[i] = i % 100 == 0 ? engine() % num_values : i;
+        break;
+      case DUPLICATES:
+        values[i] = engine() % 1000;
+        break;
+    }
+  }
+  return values;
+}
+
+std::unique_ptr<buzzdb::File> make_file(Backend backend) {
+  switch (backend) {
+    case TEST_FILE:
+      return std::make_unique<buzzdb::TestFile>();
+    case POSIX_FILE:
+      return buzzdb::File::make_temporary_file();
+    case SIMULATED_SSD: {
+      auto file = std::make_unique<buzzdb::TestFile>();
+      buzzdb::TestFile::DeviceModel device;
+      device.latency = std::chrono::microseconds(50);
+      device.bandwidth = size_t{500} << 20;
+      file->set_device_model(device);
+      return file;
+    }
+  }
+  return nullptr;
+}
+
+/// The I/O counters of this process, see proc(5).
+struct IOCounters {
+  /// Number of read system calls.
+  uint64_t read_syscalls = 0;
+  /// Number of write system calls.
+  uint64_t write_syscalls = 0;
+  /// Number of bytes passed to write system calls.
+  uint64_t bytes_written = 0;
+
+  /// Reads the counters from /proc/self/io. They stay zero where it is not
+  /// available.
+  static IOCounters read() {
+    IOCounters counters;
+    std::ifstream file("/proc/self/io");
+    std::string key;
+    uint64_t value;
+    while (file >> key >> value) {
+      if (key == "syscr:") {
+        counters.read_syscalls = value;
+      } else if (key == "syscw:") {
+        counters.write_syscalls = value;
+      } else if (key == "wchar:") {
+        counters.bytes_written = value;
+      }
+    }
+    return counters;
+  }
+};
+
+/// Sorts `state.range(0)` values with `state.range(1)` bytes of memory.
+/// `state.range(2)` is the `Distribution` of the values, `state.range(3)` the
+/// `Backend` of the input and output. Besides the throughput, reports the
+/// read and write system calls and the bytes written to temporary files per
+/// sort.
+void BM_ExternalSort(benchmark::State& state) {
+  size_t num_values = state.range(0);
+  size_t mem_size = state.range(1);
+  auto distribution = static_cast<Distribution>(state.range(2));
+  auto backend = static_cast<Backend>(state.range(3));
+
+  auto values = make_values(num_values, distribution);
+  size_t num_bytes = num_values * sizeof(uint64_t);
+  auto input = make_file(backend);
+  input->resize(num_bytes);
+  input->write_block(reinterpret_cast<const char*>(values.data()), 0, num_bytes);
+  auto output = make_file(backend);
+
+  IOCounters before = IOCounters::read();
+  for (auto _ : state) {
+    buzzdb::external_sort(*input, num_values, *output, mem_size);
+  }
+  IOCounters after = IOCounters::read();
+
+  // With a `PosixFile`, the bytes written to the output also pass through
+  // write system calls.
+  uint64_t output_bytes = backend == POSIX_FILE ? state.iterations() * num_bytes : 0;
+  uint64_t temp_bytes = after.bytes_written - before.bytes_written;
+  temp_bytes -= std::min(temp_bytes, output_bytes);
+
+  state.SetBytesProcessed(state.iterations() * num_bytes);
+  state.SetLabel(std::string(DISTRIBUTION_NAMES[distribution]) + "/" + BACKEND_NAMES[backend]);
+  state.counters["read_syscalls"] = benchmark::Counter(
+      after.read_syscalls - before.read_syscalls, benchmark::Counter::kAvgIterations);
+  state.counters["write_syscalls"] = benchmark::Counter(
+      after.write_syscalls - before.write_syscalls, benchmark::Counter::kAvgIterations);
+  state.counters["temp_bytes_written"] =
+      benchmark::Counter(temp_bytes, benchmark::Counter::kAvgIterations);
+}
+
+/// Input sizes from a single run to several merge passes, with one memory
+/// size that sorts the smallest input in memory.
+void external_sort_arguments(benchmark::internal::Benchmark* benchmark) {
+  for (int64_t num_values : {1 << 16, 1 << 20, 1 << 22}) {
+    for (int64_t mem_size : {64 << 10, 1 << 20}) {
+      for (int64_t distribution : {RANDOM, DESCENDING, NEARLY_SORTED, DUPLICATES}) {
+        for (int64_t backend : {TEST_FILE, POSIX_FILE, SIMULATED_SSD}) {
+          benchmark->Args({num_values, mem_size, distribution, backend});
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+BENCHMARK(BM_ExternalSort)
+    ->Apply(external_sort_arguments)
+    ->ArgNames({"values", "mem_size", "distribution", "backend"})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <cstdint>
 #include <exception>
 #include <iostream>
@@ -27,10 +28,32 @@ Options for print:
     "print" prints all integers contained in <input_file>.
 
 Options for sort
-    sort <input_file> <output_file> <mem_size>
+    sort [--replacement-selection] [--threads <count>] [--async-io] [--mmap]
+         [--compress-runs] [--limit <count>] [--distinct | --count]
+         [--spill-dir <directory>]... <input_file> <output_file> <mem_size>
 
     "sort" sorts the integers contained in <input_file> and writes them into
-    <output_file> by using buzzdb::external_sort().
+    <output_file> by using buzzdb::external_sort(). The elapsed time and the
+    achieved throughput in MB/s (input bytes per second) are printed when the
+    sort is done.
+
+    --replacement-selection  Form the initial runs with replacement selection
+                             instead of sorting memory-sized chunks.
+    --threads <count>        Form runs with <count> threads in parallel. Every
+                             thread uses an equal share of <mem_size>.
+    --async-io               Read and write on a background thread while
+                             sorting and merging.
+    --mmap                   Map <input_file> and <output_file> into memory
+                             instead of reading and writing them.
+    --compress-runs          Store the temporary runs delta-encoded and
+                             bit-packed.
+    --limit <count>          Write only the <count> smallest integers.
+    --distinct               Remove duplicates.
+    --count                  Write every distinct integer followed by the
+                             number of its occurrences.
+    --spill-dir <directory>  Write the temporary runs to <directory>. When
+                             given several times, the runs are striped over
+                             all directories, e.g., one per disk.
 )";
 }
 
@@ -136,13 +159,57 @@ int mode_print(int argc, const char* argv[]) {
 
 int mode_sort(int argc, const char* argv[]) {
   using File = buzzdb::File;
-  if (argc != 5) {
+  buzzdb::ExternalSortOptions options;
+  bool mmap = false;
+  bool distinct = false;
+  bool count = false;
+  int arg = 2;
+  for (; arg < argc && std::string_view{argv[arg]}.substr(0, 2) == "--"sv;
+       ++arg) {
+    if (argv[arg] == "--replacement-selection"sv) {
+      options.run_generation = buzzdb::RunGeneration::REPLACEMENT_SELECTION;
+    } else if (argv[arg] == "--async-io"sv) {
+      options.async_io = true;
+    } else if (argv[arg] == "--mmap"sv) {
+      mmap = true;
+    } else if (argv[arg] == "--distinct"sv && !count) {
+      distinct = true;
+    } else if (argv[arg] == "--count"sv && !distinct) {
+      count = true;
+    } else if (argv[arg] == "--compress-runs"sv) {
+      options.compress_runs = true;
+    } else if (argv[arg] == "--spill-dir"sv && arg + 1 < argc) {
+      options.spill_directories.push_back(argv[++arg]);
+    } else if (argv[arg] == "--limit"sv && arg + 1 < argc) {
+      std::string limit_s(argv[++arg]);
+      size_t pos = 0;
+      options.limit = std::stoull(limit_s, &pos);
+      if (pos != limit_s.size()) {
+        usage(argv[0]);
+        return 0;
+      }
+    } else if (argv[arg] == "--threads"sv && arg + 1 < argc) {
+      std::string threads_s(argv[++arg]);
+      size_t pos = 0;
+      options.num_threads = std::stoull(threads_s, &pos);
+      if (pos != threads_s.size() || options.num_threads == 0) {
+        usage(argv[0]);
+        return 0;
+      }
+    } else {
+      usage(argv[0]);
+      return 0;
+    }
+  }
+  if (argc - arg != 3) {
     usage(argv[0]);
     return 0;
   }
+  const char* input_filename = argv[arg];
+  const char* output_filename = argv[arg + 1];
   size_t mem_size;
   {
-    std::string mem_size_s(argv[4]);
+    std::string mem_size_s(argv[arg + 2]);
     size_t pos = 0;
     mem_size = std::stoull(mem_size_s, &pos);
     if (pos != mem_size_s.size()) {
@@ -150,10 +217,34 @@ int mode_sort(int argc, const char* argv[]) {
       return 0;
     }
   }
-  auto input_file = File::open_file(argv[2], File::READ);
-  auto output_file = File::open_file(argv[3], File::WRITE);
-  buzzdb::external_sort(*input_file, input_file->size() / sizeof(uint64_t),
-                           *output_file, mem_size);
+  std::unique_ptr<File> input_file;
+  std::unique_ptr<File> output_file;
+  if (mmap) {
+    input_file = File::open_mapped_file(input_filename, File::READ);
+    output_file = File::open_mapped_file(output_filename, File::WRITE);
+  } else {
+    input_file = File::open_file(input_filename, File::READ);
+    output_file = File::open_file(output_filename, File::WRITE);
+  }
+  size_t num_values = input_file->size() / sizeof(uint64_t);
+  auto start = std::chrono::steady_clock::now();
+  if (distinct) {
+    buzzdb::external_sort_distinct(*input_file, num_values, *output_file,
+                                   mem_size, options);
+  } else if (count) {
+    buzzdb::external_sort_count(*input_file, num_values, *output_file,
+                                mem_size, options);
+  } else {
+    buzzdb::external_sort(*input_file, num_values, *output_file, mem_size,
+                          options);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  double megabytes = static_cast<double>(num_values * sizeof(uint64_t)) / 1e6;
+  std::cout << "Sorted " << num_values << " values (" << megabytes
+            << " MB) in " << elapsed.count() << " s: "
+            << (elapsed.count() > 0 ? megabytes / elapsed.count() : 0.0)
+            << " MB/s" << std::endl;
   return 0;
 }
 
@@ -3,7 +3,10 @@
 #include <cstdint>
 #include <cstring>
 #include <exception>
+#include <limits>
+#include <map>
 #include <random>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -40,12 +43,416 @@ TEST(ExternalSortTest, OneValue) {
 }
 
 std::vector<uint64_t> get_file_values(buzzdb::TestFile file) {
-  auto& content = file.get_content();
+  auto content = file.get_content();
   std::vector<uint64_t> values(content.size() / 8);
   std::memcpy(values.data(), content.data(), content.size());
   return values;
 }
 
+buzzdb::TestFile make_input_file(const std::vector<uint64_t>& values) {
+  std::vector<char> file_content(values.size() * 8);
+  std::memcpy(file_content.data(), values.data(), file_content.size());
+  return buzzdb::TestFile{std::move(file_content)};
+}
+
+/// Returns `num_values` random values that only use the bits of `mask`. The
+/// values are the same for every call.
+std::vector<uint64_t> make_random_values(size_t num_values, uint64_t mask = ~0ull) {
+  std::mt19937_64 engine{42};
+  std::vector<uint64_t> values(num_values);
+  for (auto& value : values) {
+    value = engine() & mask;
+  }
+  return values;
+}
+
+/// Returns `num_values` increasing values with some noise, so that every
+/// value is out of order by at most 16 positions.
+std::vector<uint64_t> make_nearly_sorted_values(size_t num_values) {
+  std::mt19937_64 engine{42};
+  std::vector<uint64_t> values(num_values);
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = i * 16 + engine() % 256;
+  }
+  return values;
+}
+
+/// Sorts `values` with `options` and checks the output.
+void check_sort(const std::vector<uint64_t>& values, size_t mem_size,
+                const buzzdb::ExternalSortOptions& options) {
+  auto input = make_input_file(values);
+  buzzdb::TestFile output;
+
+  buzzdb::external_sort(input, values.size(), output, mem_size, options);
+
+  auto expected = values;
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(expected, get_file_values(output));
+}
+
+/// Returns the number of values in every run that replacement selection
+/// forms of `values`.
+std::vector<size_t> get_replacement_selection_run_sizes(
+    const std::vector<uint64_t>& values, size_t mem_size) {
+  auto input = make_input_file(values);
+  buzzdb::detail::SpillArea spill({}, false);
+  auto runs = buzzdb::detail::generate_replacement_selection_runs<
+      uint64_t, buzzdb::IdentityKey>(input, values.size(), spill,
+                                     buzzdb::RunFormat::PLAIN, values.size(),
+                                     mem_size, nullptr);
+  std::vector<size_t> run_sizes;
+  for (auto& run : runs) {
+    run_sizes.push_back(run.num_values);
+  }
+  return run_sizes;
+}
+
+TEST(ExternalSortTest, ReplacementSelectionRunSizes) {
+  // 1 KiB of memory holds a heap of 112 values next to the I/O buffers.
+  constexpr size_t heap_capacity = 112;
+
+  // Runs of random values are twice as long as the heap on average. Only
+  // the last run may be shorter than the heap.
+  auto run_sizes = get_replacement_selection_run_sizes(make_random_values(20000), MEM_1KiB);
+  ASSERT_GT(run_sizes.size(), 1);
+  for (size_t i = 0; i + 1 < run_sizes.size(); ++i) {
+    ASSERT_GE(run_sizes[i], heap_capacity);
+  }
+  size_t average_run_size = 20000 / run_sizes.size();
+  ASSERT_GE(average_run_size, 2 * heap_capacity * 9 / 10);
+  ASSERT_LE(average_run_size, 2 * heap_capacity * 11 / 10);
+
+  // Values that are out of order by less than the heap capacity form a
+  // single run.
+  run_sizes = get_replacement_selection_run_sizes(make_nearly_sorted_values(20000), MEM_1KiB);
+  ASSERT_EQ(std::vector<size_t>{20000}, run_sizes);
+}
+
+/// Run generation, number of threads, asynchronous I/O, compressed runs and
+/// memory size of a sort.
+using SortConfig = std::tuple<buzzdb::RunGeneration, size_t, bool, bool, size_t>;
+
+class ExternalSortOptionsTest : public ::testing::TestWithParam<SortConfig> {
+ protected:
+  buzzdb::ExternalSortOptions get_options() const {
+    buzzdb::ExternalSortOptions options;
+    std::tie(options.run_generation, options.num_threads, options.async_io,
+             options.compress_runs, std::ignore) = GetParam();
+    return options;
+  }
+
+  size_t get_mem_size() const { return std::get<4>(GetParam()); }
+};
+
+TEST_P(ExternalSortOptionsTest, RandomNumbers) {
+  // Dense values compress well, values over the full range hardly at all.
+  for (uint64_t mask : {0xffffull, ~0ull}) {
+    check_sort(make_random_values(20000, mask), get_mem_size(), get_options());
+  }
+}
+
+TEST_P(ExternalSortOptionsTest, NearlySortedNumbers) {
+  check_sort(make_nearly_sorted_values(20000), get_mem_size(), get_options());
+}
+
+INSTANTIATE_TEST_CASE_P(
+    ExternalSortTest, ExternalSortOptionsTest,
+    ::testing::Combine(::testing::Values(buzzdb::RunGeneration::SORT,
+                                         buzzdb::RunGeneration::REPLACEMENT_SELECTION),
+                       ::testing::Values(1, 3, 4), ::testing::Bool(), ::testing::Bool(),
+                       ::testing::Values(MEM_1KiB, 64 * MEM_1KiB)));
+
+TEST(ExternalSortTest, ParallelMerge) {
+  // Heavy duplicates leave some key ranges empty, and a single distinct
+  // value puts all records into one of them.
+  for (uint64_t mask : {0ull, 0x7ull, ~0ull}) {
+    auto values = make_random_values(30000, mask);
+    auto input = make_input_file(values);
+    auto expected = values;
+    std::sort(expected.begin(), expected.end());
+    for (auto run_generation : {buzzdb::RunGeneration::SORT,
+                                buzzdb::RunGeneration::REPLACEMENT_SELECTION}) {
+      for (size_t num_threads : {2, 3, 8}) {
+        for (size_t mem_size : {MEM_1KiB, 64 * MEM_1KiB}) {
+          buzzdb::TestFile output;
+          buzzdb::ExternalSortOptions options;
+          options.run_generation = run_generation;
+          options.num_threads = num_threads;
+          options.async_io = num_threads == 3;
+
+          buzzdb::external_sort(input, values.size(), output, mem_size, options);
+
+          ASSERT_EQ(expected, get_file_values(output));
+        }
+      }
+    }
+  }
+}
+
+TEST(ExternalSortTest, TwoRuns) {
+  // 1 KiB of memory holds 128 values, so the values form two runs that are
+  // merged at once.
+  for (uint64_t mask : {0xfull, ~0ull}) {
+    auto values = make_random_values(250, mask);
+    for (bool async_io : {false, true}) {
+      buzzdb::ExternalSortOptions options;
+      options.async_io = async_io;
+      check_sort(values, MEM_1KiB, options);
+    }
+  }
+}
+
+TEST(ExternalSortTest, Limit) {
+  // 1 KiB of memory selects up to 60 values in a single pass, larger limits
+  // are sorted with truncated runs.
+  for (uint64_t mask : {0xfull, ~0ull}) {
+    auto values = make_random_values(5000, mask);
+    auto input = make_input_file(values);
+    auto expected = values;
+    std::sort(expected.begin(), expected.end());
+    for (auto run_generation : {buzzdb::RunGeneration::SORT,
+                                buzzdb::RunGeneration::REPLACEMENT_SELECTION}) {
+      for (bool async_io : {false, true}) {
+        for (size_t limit : {0, 1, 60, 61, 1000, 4999, 5000, 6000}) {
+          buzzdb::TestFile output;
+          buzzdb::ExternalSortOptions options;
+          options.run_generation = run_generation;
+          options.num_threads = 3;
+          options.async_io = async_io;
+          options.limit = limit;
+
+          buzzdb::external_sort(input, values.size(), output, MEM_1KiB, options);
+
+          size_t count = std::min(limit, values.size());
+          ASSERT_EQ(std::vector<uint64_t>(expected.begin(), expected.begin() + count),
+                    get_file_values(output));
+        }
+      }
+    }
+  }
+}
+
+TEST(ExternalSortTest, DistinctAndCount) {
+  std::mt19937_64 engine{42};
+  // Skewed values with many duplicates, and values that are all distinct.
+  for (uint64_t mask : {0xffull, ~0ull}) {
+    std::vector<uint64_t> values(20000);
+    for (auto& value : values) {
+      value = engine() & engine() & mask;
+    }
+    auto input = make_input_file(values);
+    std::map<uint64_t, uint64_t> counts;
+    for (uint64_t value : values) {
+      ++counts[value];
+    }
+    for (size_t mem_size : {MEM_1KiB, MEM_1MiB}) {
+      for (bool async_io : {false, true}) {
+        for (size_t limit : {size_t{10}, std::numeric_limits<size_t>::max()}) {
+          buzzdb::ExternalSortOptions options;
+          options.num_threads = 3;
+          options.async_io = async_io;
+          options.compress_runs = async_io;
+          options.limit = limit;
+          std::vector<uint64_t> expected_values;
+          std::vector<uint64_t> expected_counts;
+          for (auto [value, count] : counts) {
+            if (expected_values.size() < limit) {
+              expected_values.push_back(value);
+              expected_counts.push_back(value);
+              expected_counts.push_back(count);
+            }
+          }
+
+          buzzdb::TestFile distinct_output;
+          size_t num_distinct = buzzdb::external_sort_distinct(
+              input, values.size(), distinct_output, mem_size, options);
+          ASSERT_EQ(expected_values.size(), num_distinct);
+          ASSERT_EQ(expected_values, get_file_values(distinct_output));
+
+          buzzdb::TestFile count_output;
+          size_t num_counts = buzzdb::external_sort_count(
+              input, values.size(), count_output, mem_size, options);
+          ASSERT_EQ(expected_values.size(), num_counts);
+          ASSERT_EQ(expected_counts, get_file_values(count_output));
+        }
+      }
+    }
+  }
+}
+
+TEST(ExternalSortTest, SpillDirectories) {
+  // The same directory twice still stripes the runs over two sets of files.
+  auto values = make_random_values(20000, 0xffffff);
+  auto input = make_input_file(values);
+  auto expected = values;
+  std::sort(expected.begin(), expected.end());
+  std::vector<uint64_t> expected_distinct = expected;
+  expected_distinct.erase(std::unique(expected_distinct.begin(), expected_distinct.end()),
+                          expected_distinct.end());
+  for (auto run_generation : {buzzdb::RunGeneration::SORT,
+                              buzzdb::RunGeneration::REPLACEMENT_SELECTION}) {
+    for (bool async_io : {false, true}) {
+      for (bool compress_runs : {false, true}) {
+        buzzdb::ExternalSortOptions options;
+        options.run_generation = run_generation;
+        options.num_threads = 3;
+        options.async_io = async_io;
+        options.compress_runs = compress_runs;
+        options.spill_directories = {".", ".", "."};
+
+        buzzdb::TestFile output;
+        buzzdb::external_sort(input, values.size(), output, MEM_1KiB, options);
+        ASSERT_EQ(expected, get_file_values(output));
+
+        buzzdb::TestFile distinct_output;
+        buzzdb::external_sort_distinct(input, values.size(), distinct_output, MEM_1KiB,
+                                       options);
+        ASSERT_EQ(expected_distinct, get_file_values(distinct_output));
+      }
+    }
+  }
+}
+
+/// A tuple of a key and a tuple id, e.g., an index entry.
+struct KeyTid {
+  uint64_t key;
+  uint64_t tid;
+
+  bool operator<(const KeyTid& other) const {
+    return std::tie(key, tid) < std::tie(other.key, other.tid);
+  }
+  bool operator==(const KeyTid& other) const {
+    return key == other.key && tid == other.tid;
+  }
+};
+
+struct KeyTidKey {
+  uint64_t operator()(const KeyTid& record) const { return record.key; }
+};
+
+/// A row with three signed columns that is sorted by its second column.
+struct Row {
+  int32_t columns[3];
+
+  bool operator<(const Row& other) const {
+    return std::lexicographical_compare(columns, columns + 3, other.columns,
+                                        other.columns + 3);
+  }
+  bool operator==(const Row& other) const {
+    return std::equal(columns, columns + 3, other.columns);
+  }
+};
+
+struct RowKey {
+  /// Flips the sign bit, so that the unsigned keys are ordered like the
+  /// signed column.
+  uint32_t operator()(const Row& row) const {
+    return static_cast<uint32_t>(row.columns[1]) ^ 0x80000000u;
+  }
+};
+
+template <typename Record>
+buzzdb::TestFile make_record_file(const std::vector<Record>& records) {
+  std::vector<char> file_content(records.size() * sizeof(Record));
+  std::memcpy(file_content.data(), records.data(), file_content.size());
+  return buzzdb::TestFile{std::move(file_content)};
+}
+
+template <typename Record>
+std::vector<Record> get_file_records(buzzdb::TestFile file) {
+  auto content = file.get_content();
+  std::vector<Record> records(content.size() / sizeof(Record));
+  std::memcpy(records.data(), content.data(), content.size());
+  return records;
+}
+
+/// Sorts `records` with all run generation strategies and with and without
+/// asynchronous I/O, and checks that the output is ordered by key and is a
+/// permutation of the input.
+template <typename Record, typename KeyFn>
+void check_record_sort(const std::vector<Record>& records, size_t mem_size) {
+  auto input = make_record_file(records);
+  auto expected = records;
+  std::sort(expected.begin(), expected.end());
+  for (auto run_generation : {buzzdb::RunGeneration::SORT,
+                              buzzdb::RunGeneration::REPLACEMENT_SELECTION}) {
+    for (bool async_io : {false, true}) {
+      buzzdb::TestFile output;
+      buzzdb::ExternalSortOptions options;
+      options.run_generation = run_generation;
+      options.async_io = async_io;
+
+      buzzdb::external_sort<Record, KeyFn>(input, records.size(), output,
+                                           mem_size, options);
+
+      auto output_records = get_file_records<Record>(output);
+      ASSERT_EQ(records.size(), output_records.size());
+      ASSERT_TRUE(std::is_sorted(output_records.begin(), output_records.end(),
+                                 [](const Record& a, const Record& b) {
+                                   return KeyFn{}(a) < KeyFn{}(b);
+                                 }));
+      std::sort(output_records.begin(), output_records.end());
+      ASSERT_EQ(expected, output_records);
+    }
+  }
+}
+
+TEST(ExternalSortTest, KeyTidRecords) {
+  std::mt19937_64 engine{42};
+  std::vector<KeyTid> records(20000);
+  for (size_t i = 0; i < records.size(); ++i) {
+    // Few distinct keys, so that many records have equal keys.
+    records[i] = {engine() % 1000, i};
+  }
+  // Multi-pass merge required:
+  check_record_sort<KeyTid, KeyTidKey>(records, MEM_1KiB);
+  // All records fit in memory:
+  check_record_sort<KeyTid, KeyTidKey>(records, MEM_1MiB);
+}
+
+TEST(ExternalSortTest, KeyTidRecordsWithLimit) {
+  // Records with equal keys may be chosen in any order, so only the keys of
+  // the output are deterministic.
+  std::mt19937_64 engine{42};
+  std::vector<KeyTid> records(20000);
+  for (size_t i = 0; i < records.size(); ++i) {
+    records[i] = {engine() % 1000, i};
+  }
+  auto input = make_record_file(records);
+  auto expected = records;
+  std::sort(expected.begin(), expected.end());
+  for (size_t limit : {30, 3000}) {
+    for (auto run_generation : {buzzdb::RunGeneration::SORT,
+                                buzzdb::RunGeneration::REPLACEMENT_SELECTION}) {
+      buzzdb::TestFile output;
+      buzzdb::ExternalSortOptions options;
+      options.run_generation = run_generation;
+      options.limit = limit;
+
+      buzzdb::external_sort<KeyTid, KeyTidKey>(input, records.size(), output,
+                                               MEM_1KiB, options);
+
+      auto output_records = get_file_records<KeyTid>(output);
+      ASSERT_EQ(limit, output_records.size());
+      for (size_t i = 0; i < limit; ++i) {
+        ASSERT_EQ(expected[i].key, output_records[i].key);
+        ASSERT_EQ(records[output_records[i].tid].key, output_records[i].key);
+      }
+    }
+  }
+}
+
+TEST(ExternalSortTest, RowsWithKeyExtractor) {
+  std::mt19937_64 engine{42};
+  std::vector<Row> records(20000);
+  for (auto& record : records) {
+    for (auto& column : record.columns) {
+      column = static_cast<int32_t>(engine());
+    }
+  }
+  check_record_sort<Row, RowKey>(records, MEM_1KiB);
+}
+
 class ExternalSortParametrizedTest
     : public ::testing::TestWithParam<std::pair<size_t, size_t>> {};
 
@@ -79,7 +486,9 @@ INSTANTIATE_TEST_CASE_P(
         std::make_pair(MEM_1KiB, 128), std::make_pair(MEM_1MiB, 100000),
         // n-way merge required:
         std::make_pair(MEM_1KiB, 129), std::make_pair(MEM_1KiB, 997),
-        std::make_pair(MEM_1KiB, 1024), std::make_pair(MEM_1MiB, 200000)));
+        std::make_pair(MEM_1KiB, 1024), std::make_pair(MEM_1MiB, 200000),
+        // Multi-pass merge required:
+        std::make_pair(MEM_1KiB, 20000), std::make_pair(MEM_1KiB, 65536)));
 }
 int main(int argc, char* argv[]) {
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+#include "external_sort/io_thread.h"
+
+namespace {
+
+TEST(IOThreadTest, ExecutesRequestsInOrder) {
+  std::vector<int> executed;
+  std::vector<std::future<void>> done;
+  {
+    buzzdb::IOThread io;
+    for (int i = 0; i < 100; ++i) {
+      done.push_back(io.submit([&executed, i] { executed.push_back(i); }));
+    }
+    done.front().get();
+    // The destructor executes the remaining requests.
+  }
+  ASSERT_EQ(100, executed.size());
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_EQ(i, executed[i]);
+  }
+}
+
+TEST(IOThreadTest, RethrowsExceptions) {
+  buzzdb::IOThread io;
+  auto failed = io.submit([] { throw std::runtime_error("read failed"); });
+  auto succeeded = io.submit([] {});
+  ASSERT_THROW(failed.get(), std::runtime_error);
+  ASSERT_NO_THROW(succeeded.get());
+}
+
+TEST(IOThreadTest, WithoutThreadExecutesRightAway) {
+  bool executed = false;
+  auto done = buzzdb::IOThread::submit(nullptr, [&executed] { executed = true; });
+  ASSERT_TRUE(executed);
+  ASSERT_NO_THROW(done.get());
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "external_sort/loser_tree.h"
+#include "external_sort/run_io.h"
+#include "storage/test_file.h"
+
+namespace {
+
+/// Writes `num_runs` sorted runs of random length back to back into `file`
+/// and returns one reader per run together with all values.
+std::vector<uint64_t> make_runs(
+    buzzdb::TestFile& file, size_t num_runs, uint64_t max_value,
+    std::vector<std::unique_ptr<buzzdb::RunReader>>& readers) {
+  std::mt19937_64 engine{42};
+  std::vector<std::vector<uint64_t>> runs(num_runs);
+  size_t total = 0;
+  for (auto& run : runs) {
+    // Some runs are empty.
+    run.resize(engine() % 200);
+    for (auto& value : run) {
+      value = engine() % max_value;
+    }
+    std::sort(run.begin(), run.end());
+    total += run.size();
+  }
+  file.resize(total * 8);
+  std::vector<uint64_t> all_values;
+  size_t offset = 0;
+  for (auto& run : runs) {
+    file.write_block(reinterpret_cast<const char*>(run.data()), offset,
+                     run.size() * 8);
+    // Small buffers make the batches cross buffer refills.
+    readers.push_back(
+        std::make_unique<buzzdb::RunReader>(file, offset, run.size(), 64));
+    offset += run.size() * 8;
+    all_values.insert(all_values.end(), run.begin(), run.end());
+  }
+  std::sort(all_values.begin(), all_values.end());
+  return all_values;
+}
+
+class LoserTreeParametrizedTest
+    : public ::testing::TestWithParam<std::pair<size_t, uint64_t>> {};
+
+TEST_P(LoserTreeParametrizedTest, MergeBatches) {
+  auto [num_runs, max_value] = GetParam();
+  buzzdb::TestFile file;
+  std::vector<std::unique_ptr<buzzdb::RunReader>> readers;
+  auto expected_values = make_runs(file, num_runs, max_value, readers);
+  std::vector<buzzdb::RunReader*> inputs;
+  for (auto& reader : readers) {
+    inputs.push_back(reader.get());
+  }
+
+  buzzdb::LoserTree tree(std::move(inputs));
+  std::vector<uint64_t> values;
+  while (tree.has_next()) {
+    size_t count = 0;
+    const uint64_t* batch = tree.batch(count);
+    ASSERT_GE(count, 1);
+    values.insert(values.end(), batch, batch + count);
+    tree.pop(count);
+  }
+
+  ASSERT_EQ(expected_values, values);
+}
+
+TEST_P(LoserTreeParametrizedTest, MergeSingleValues) {
+  auto [num_runs, max_value] = GetParam();
+  buzzdb::TestFile file;
+  std::vector<std::unique_ptr<buzzdb::RunReader>> readers;
+  auto expected_values = make_runs(file, num_runs, max_value, readers);
+  std::vector<buzzdb::RunReader*> inputs;
+  for (auto& reader : readers) {
+    inputs.push_back(reader.get());
+  }
+
+  buzzdb::LoserTree tree(std::move(inputs));
+  std::vector<uint64_t> values;
+  while (tree.has_next()) {
+    values.push_back(tree.peek());
+    tree.pop();
+  }
+
+  ASSERT_EQ(expected_values, values);
+}
+
+INSTANTIATE_TEST_CASE_P(
+    LoserTreeTest, LoserTreeParametrizedTest,
+    ::testing::Values(std::make_pair(0, 1000), std::make_pair(1, 1000),
+                      std::make_pair(2, 1000), std::make_pair(7, 1000),
+                      std::make_pair(300, ~0ull), std::make_pair(300, 10)));
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
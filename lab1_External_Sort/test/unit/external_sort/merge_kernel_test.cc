@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "external_sort/merge_kernel.h"
+
+namespace {
+
+std::vector<uint64_t> make_sorted_values(std::mt19937_64& engine, size_t num_values,
+                                         uint64_t mask) {
+  std::vector<uint64_t> values(num_values);
+  for (auto& value : values) {
+    value = engine() & mask;
+  }
+  std::sort(values.begin(), values.end());
+  return values;
+}
+
+void check_merge(buzzdb::MergeKernel kernel, const std::vector<uint64_t>& a,
+                 const std::vector<uint64_t>& b) {
+  std::vector<uint64_t> expected;
+  std::merge(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+  std::vector<uint64_t> output(a.size() + b.size());
+  buzzdb::merge_sorted(kernel, a.data(), a.size(), b.data(), b.size(), output.data());
+  ASSERT_EQ(expected, output);
+}
+
+class MergeKernelTest : public ::testing::TestWithParam<buzzdb::MergeKernel> {};
+
+TEST_P(MergeKernelTest, AllSizes) {
+  if (!buzzdb::is_supported(GetParam())) {
+    return;
+  }
+  std::mt19937_64 engine{42};
+  for (size_t size_a = 0; size_a < 40; ++size_a) {
+    for (size_t size_b = 0; size_b < 40; ++size_b) {
+      auto a = make_sorted_values(engine, size_a, ~0ull);
+      auto b = make_sorted_values(engine, size_b, ~0ull);
+      check_merge(GetParam(), a, b);
+    }
+  }
+}
+
+TEST_P(MergeKernelTest, LargeInputs) {
+  if (!buzzdb::is_supported(GetParam())) {
+    return;
+  }
+  std::mt19937_64 engine{42};
+  // Few distinct values, values with and without the highest bit set.
+  for (uint64_t mask : {0xfull, 0xffffull, ~0ull}) {
+    for (auto [size_a, size_b] : {std::make_pair(10000, 10000), std::make_pair(10003, 97),
+                                  std::make_pair(5, 20001)}) {
+      auto a = make_sorted_values(engine, size_a, mask);
+      auto b = make_sorted_values(engine, size_b, mask);
+      check_merge(GetParam(), a, b);
+    }
+  }
+}
+
+TEST_P(MergeKernelTest, ClusteredInputs) {
+  if (!buzzdb::is_supported(GetParam())) {
+    return;
+  }
+  // One input is entirely smaller than the other, or the inputs alternate
+  // between long stretches.
+  std::vector<uint64_t> low(1000);
+  std::vector<uint64_t> high(1000);
+  std::vector<uint64_t> even(1000);
+  std::vector<uint64_t> odd(1000);
+  for (size_t i = 0; i < 1000; ++i) {
+    low[i] = i;
+    high[i] = (1ull << 63) + i;
+    even[i] = (i / 100 * 2) * 1000 + i;
+    odd[i] = (i / 100 * 2 + 1) * 1000 + i;
+  }
+  check_merge(GetParam(), low, high);
+  check_merge(GetParam(), high, low);
+  check_merge(GetParam(), even, odd);
+  check_merge(GetParam(), odd, even);
+}
+
+INSTANTIATE_TEST_CASE_P(MergeKernelTest, MergeKernelTest,
+                        ::testing::Values(buzzdb::MergeKernel::SCALAR,
+                                          buzzdb::MergeKernel::AVX2,
+                                          buzzdb::MergeKernel::AVX512));
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "external_sort/radix_sort.h"
+
+namespace {
+
+std::vector<uint64_t> make_random_values(size_t num_values, uint64_t mask) {
+  std::mt19937_64 engine{42};
+  std::vector<uint64_t> values(num_values);
+  for (auto& value : values) {
+    value = engine() & mask;
+  }
+  return values;
+}
+
+class RadixSortParametrizedTest
+    : public ::testing::TestWithParam<std::pair<size_t, uint64_t>> {};
+
+TEST_P(RadixSortParametrizedTest, InPlace) {
+  auto [num_values, mask] = GetParam();
+  auto values = make_random_values(num_values, mask);
+  auto expected_values = values;
+  std::sort(expected_values.begin(), expected_values.end());
+
+  buzzdb::radix_sort(values.data(), values.size());
+
+  ASSERT_EQ(expected_values, values);
+}
+
+TEST_P(RadixSortParametrizedTest, WithScratch) {
+  auto [num_values, mask] = GetParam();
+  auto values = make_random_values(num_values, mask);
+  auto expected_values = values;
+  std::sort(expected_values.begin(), expected_values.end());
+  std::vector<uint64_t> scratch(
+      std::min(num_values, buzzdb::RADIX_SORT_SCRATCH_VALUES));
+
+  buzzdb::radix_sort(values.data(), values.size(), scratch.data());
+
+  ASSERT_EQ(expected_values, values);
+}
+
+INSTANTIATE_TEST_CASE_P(
+    RadixSortTest, RadixSortParametrizedTest,
+    ::testing::Values(
+        // Small enough for the std::sort fallback:
+        std::make_pair(0, ~0ull), std::make_pair(1, ~0ull),
+        std::make_pair(63, ~0ull),
+        // Uniform random values:
+        std::make_pair(64, ~0ull), std::make_pair(100000, ~0ull),
+        // Many duplicates and constant digits:
+        std::make_pair(100000, 0xffull), std::make_pair(100000, 0xff00ff00ull),
+        std::make_pair(100000, 0ull)));
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "external_sort/run_codec.h"
+
+namespace {
+
+/// Encodes `values` in blocks with `kernel` and checks that every kernel
+/// decodes them again. Returns the encoded size.
+size_t check_round_trip(buzzdb::CodecKernel kernel, const std::vector<uint64_t>& values) {
+  std::vector<char> encoded(buzzdb::max_encoded_size(values.size()));
+  size_t size = 0;
+  for (size_t begin = 0; begin < values.size(); begin += buzzdb::CODEC_BLOCK_VALUES) {
+    size_t count = std::min(buzzdb::CODEC_BLOCK_VALUES, values.size() - begin);
+    size_t block_size =
+        buzzdb::encode_block(kernel, values.data() + begin, count, encoded.data() + size);
+    EXPECT_EQ(block_size, buzzdb::encoded_block_size(encoded.data() + size));
+    EXPECT_LE(block_size, buzzdb::CODEC_MAX_BLOCK_SIZE);
+    size += block_size;
+  }
+
+  for (auto decoder : {buzzdb::CodecKernel::SCALAR, buzzdb::CodecKernel::AVX2}) {
+    if (!buzzdb::is_supported(decoder)) {
+      continue;
+    }
+    std::vector<uint64_t> decoded;
+    for (size_t offset = 0; offset < size;) {
+      uint64_t block[buzzdb::CODEC_BLOCK_VALUES];
+      size_t count = buzzdb::decode_block(decoder, encoded.data() + offset, block);
+      decoded.insert(decoded.end(), block, block + count);
+      offset += buzzdb::encoded_block_size(encoded.data() + offset);
+    }
+    EXPECT_EQ(values, decoded);
+  }
+  return size;
+}
+
+class RunCodecTest : public ::testing::TestWithParam<buzzdb::CodecKernel> {};
+
+TEST_P(RunCodecTest, AllBlockSizes) {
+  if (!buzzdb::is_supported(GetParam())) {
+    return;
+  }
+  std::mt19937_64 engine{42};
+  for (size_t num_values = 1; num_values <= buzzdb::CODEC_BLOCK_VALUES; ++num_values) {
+    std::vector<uint64_t> values(num_values);
+    for (auto& value : values) {
+      value = engine() >> (num_values % 64);
+    }
+    std::sort(values.begin(), values.end());
+    check_round_trip(GetParam(), values);
+  }
+}
+
+TEST_P(RunCodecTest, AllWidths) {
+  if (!buzzdb::is_supported(GetParam())) {
+    return;
+  }
+  std::mt19937_64 engine{42};
+  for (unsigned width = 0; width <= 64; ++width) {
+    // Consecutive values differ by less than 2^width.
+    std::vector<uint64_t> values(1000);
+    uint64_t value = engine();
+    for (auto& v : values) {
+      v = value;
+      value += width == 0 ? 0 : engine() >> (64 - width);
+    }
+    check_round_trip(GetParam(), values);
+  }
+}
+
+TEST_P(RunCodecTest, SortedValuesBecomeSmaller) {
+  if (!buzzdb::is_supported(GetParam())) {
+    return;
+  }
+  std::mt19937_64 engine{42};
+  std::vector<uint64_t> values(100000);
+  for (auto& value : values) {
+    value = engine() & 0xffffffffull;
+  }
+  std::sort(values.begin(), values.end());
+  size_t size = check_round_trip(GetParam(), values);
+  // The differences need about 16 bits instead of 64.
+  EXPECT_LT(size * 3, values.size() * sizeof(uint64_t));
+
+  std::vector<uint64_t> duplicates(1000, 42);
+  EXPECT_EQ(8 * buzzdb::CODEC_HEADER_SIZE, check_round_trip(GetParam(), duplicates));
+}
+
+TEST_P(RunCodecTest, UnsortedValues) {
+  if (!buzzdb::is_supported(GetParam())) {
+    return;
+  }
+  std::mt19937_64 engine{42};
+  std::vector<uint64_t> values(1000);
+  for (auto& value : values) {
+    value = engine();
+  }
+  check_round_trip(GetParam(), values);
+}
+
+INSTANTIATE_TEST_CASE_P(RunCodecTest, RunCodecTest,
+                        ::testing::Values(buzzdb::CodecKernel::SCALAR,
+                                          buzzdb::CodecKernel::AVX2));
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "external_sort/streaming_sort.h"
+
+namespace {
+
+constexpr size_t MEM_1KiB = 1ul << 10;
+constexpr size_t MEM_1MiB = 1ul << 20;
+
+std::vector<uint64_t> make_values(size_t num_values) {
+  std::mt19937_64 engine{42};
+  std::vector<uint64_t> values(num_values);
+  for (auto& value : values) {
+    value = engine();
+  }
+  return values;
+}
+
+/// Pushes `values` into a sorter, alternating between single values and
+/// batches, and checks that they are pulled in order.
+void check_streaming_sort(const std::vector<uint64_t>& values, size_t mem_size,
+                          const buzzdb::ExternalSortOptions& options) {
+  buzzdb::StreamingSorter sorter(mem_size, options);
+  for (size_t i = 0; i < values.size();) {
+    if (i % 2 == 0) {
+      sorter.push(values[i]);
+      ++i;
+    } else {
+      size_t count = std::min<size_t>(values.size() - i, 1 + i % 300);
+      sorter.push(values.data() + i, count);
+      i += count;
+    }
+  }
+  sorter.finish();
+
+  std::vector<uint64_t> output;
+  std::vector<uint64_t> batch(100);
+  while (sorter.has_next()) {
+    if (output.size() % 2 == 0) {
+      output.push_back(sorter.pull());
+    } else {
+      size_t count = sorter.pull(batch.data(), 1 + output.size() % batch.size());
+      output.insert(output.end(), batch.begin(), batch.begin() + count);
+    }
+  }
+  ASSERT_EQ(0u, sorter.pull(batch.data(), batch.size()));
+
+  auto expected = values;
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(expected, output);
+}
+
+TEST(StreamingSortTest, NoValues) {
+  buzzdb::StreamingSorter sorter(MEM_1KiB);
+  sorter.finish();
+  ASSERT_FALSE(sorter.has_next());
+}
+
+TEST(StreamingSortTest, InMemory) {
+  check_streaming_sort(make_values(1000), MEM_1MiB, {});
+}
+
+TEST(StreamingSortTest, SpilledRuns) {
+  // 1 KiB of memory needs several merge passes for 20000 values.
+  auto values = make_values(20000);
+  for (bool async_io : {false, true}) {
+    for (bool compress_runs : {false, true}) {
+      buzzdb::ExternalSortOptions options;
+      options.async_io = async_io;
+      options.compress_runs = compress_runs;
+      check_streaming_sort(values, MEM_1KiB, options);
+      check_streaming_sort(values, 64 * MEM_1KiB, options);
+      options.spill_directories = {".", "."};
+      check_streaming_sort(values, MEM_1KiB, options);
+    }
+  }
+}
+
+TEST(StreamingSortTest, KeyExtractor) {
+  // Sorts the values by their lower half only.
+  struct LowKey {
+    uint32_t operator()(uint64_t value) const { return static_cast<uint32_t>(value); }
+  };
+  auto values = make_values(5000);
+  buzzdb::BasicStreamingSorter<uint64_t, LowKey> sorter(MEM_1KiB);
+  sorter.push(values.data(), values.size());
+  sorter.finish();
+  std::vector<uint64_t> output;
+  while (sorter.has_next()) {
+    output.push_back(sorter.pull());
+  }
+  ASSERT_EQ(values.size(), output.size());
+  ASSERT_TRUE(std::is_sorted(output.begin(), output.end(), [](uint64_t a, uint64_t b) {
+    return LowKey{}(a) < LowKey{}(b);
+  }));
+  std::sort(values.begin(), values.end());
+  std::sort(output.begin(), output.end());
+  ASSERT_EQ(values, output);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
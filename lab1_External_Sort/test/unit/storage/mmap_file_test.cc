@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "storage/file.h"
+
+namespace {
+
+using buzzdb::File;
+
+/// Path of a file that is removed at the end of the test.
+class MmapFileTest : public ::testing::Test {
+ protected:
+  void TearDown() override { ::unlink(filename.c_str()); }
+
+  std::string filename = ".mmap_file_test-" + std::to_string(::getpid());
+};
+
+TEST_F(MmapFileTest, ReadWriteAndView) {
+  auto file = File::open_mapped_file(filename.c_str(), File::WRITE);
+  ASSERT_EQ(0, file->size());
+  ASSERT_EQ(nullptr, file->view_block(0, 1));
+
+  std::vector<char> block(10000);
+  std::iota(block.begin(), block.end(), 0);
+  file->resize(block.size());
+  file->write_block(block.data(), 0, block.size());
+  file->advise(File::SEQUENTIAL, 0, block.size());
+
+  const char* view = file->view_block(100, 200);
+  ASSERT_NE(nullptr, view);
+  ASSERT_EQ(0, std::memcmp(block.data() + 100, view, 200));
+
+  // Views reflect later writes.
+  char zeros[200] = {};
+  file->write_block(zeros, 100, sizeof(zeros));
+  ASSERT_EQ(0, std::memcmp(zeros, view, sizeof(zeros)));
+  ASSERT_THROW(file->write_block(zeros, block.size() - 1, 2), std::out_of_range);
+  file->sync();
+}
+
+TEST_F(MmapFileTest, Resize) {
+  auto file = File::open_mapped_file(filename.c_str(), File::WRITE);
+  std::vector<char> block(5000, 'a');
+  file->resize(block.size());
+  file->write_block(block.data(), 0, block.size());
+
+  // Growing remaps the file and keeps its content.
+  file->resize(3 * block.size());
+  file->write_block(block.data(), 2 * block.size(), block.size());
+  std::vector<char> expected(3 * block.size(), 0);
+  std::fill(expected.begin(), expected.begin() + block.size(), 'a');
+  std::fill(expected.end() - block.size(), expected.end(), 'a');
+  std::vector<char> content(expected.size());
+  file->read_block(0, content.size(), content.data());
+  ASSERT_EQ(expected, content);
+
+  file->resize(10);
+  ASSERT_EQ(nullptr, file->view_block(5, 10));
+  file->resize(0);
+  file->resize(10);
+  file->read_block(0, 10, content.data());
+  ASSERT_EQ(std::vector<char>(10, 0), std::vector<char>(content.begin(), content.begin() + 10));
+  file.reset();
+
+  // The content is visible through a regular file.
+  auto reopened = File::open_file(filename.c_str(), File::READ);
+  ASSERT_EQ(10, reopened->size());
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
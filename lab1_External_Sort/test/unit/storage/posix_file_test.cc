@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include "storage/file.h"
+
+namespace {
+
+using buzzdb::File;
+
+class PosixFileTest : public ::testing::TestWithParam<File::IOMode> {};
+
+TEST_P(PosixFileTest, AlignedAndUnalignedRequests) {
+  auto file = File::make_temporary_file(GetParam());
+  constexpr size_t BLOCK = File::DIRECT_IO_ALIGNMENT;
+  file->resize(4 * BLOCK);
+
+  // An aligned request, which bypasses the page cache in DIRECT mode.
+  auto aligned = File::allocate_aligned_block(2 * BLOCK);
+  std::iota(aligned.get(), aligned.get() + 2 * BLOCK, 0);
+  file->write_block(aligned.get(), BLOCK, 2 * BLOCK);
+
+  // An unaligned request that overlaps the aligned one.
+  std::vector<char> unaligned(100, 'x');
+  file->write_block(unaligned.data(), BLOCK + 10, unaligned.size());
+  file->sync();
+
+  std::vector<char> expected(4 * BLOCK, 0);
+  std::iota(expected.begin() + BLOCK, expected.begin() + 3 * BLOCK, 0);
+  std::memset(expected.data() + BLOCK + 10, 'x', unaligned.size());
+
+  auto content = File::allocate_aligned_block(4 * BLOCK);
+  file->read_block(0, 4 * BLOCK, content.get());
+  ASSERT_EQ(0, std::memcmp(expected.data(), content.get(), 4 * BLOCK));
+
+  std::vector<char> part(BLOCK + 1);
+  file->read_block(BLOCK - 1, part.size(), part.data());
+  ASSERT_EQ(0, std::memcmp(expected.data() + BLOCK - 1, part.data(), part.size()));
+}
+
+TEST_P(PosixFileTest, BatchedRequests) {
+  auto file = File::make_temporary_file(GetParam());
+  constexpr size_t BLOCK = File::DIRECT_IO_ALIGNMENT;
+  file->resize(8 * BLOCK);
+
+  // Three adjacent aligned blocks, an unaligned block right after them and
+  // one after a gap.
+  auto blocks = File::allocate_aligned_block(5 * BLOCK);
+  std::iota(blocks.get(), blocks.get() + 5 * BLOCK, 1);
+  file->write_blocks({{blocks.get(), 0, BLOCK},
+                      {blocks.get() + BLOCK, BLOCK, BLOCK},
+                      {blocks.get() + 2 * BLOCK, 2 * BLOCK, BLOCK},
+                      {blocks.get() + 3 * BLOCK, 3 * BLOCK, 10},
+                      {blocks.get() + 4 * BLOCK, 6 * BLOCK, BLOCK}});
+
+  std::vector<char> expected(8 * BLOCK, 0);
+  std::memcpy(expected.data(), blocks.get(), 3 * BLOCK + 10);
+  std::memcpy(expected.data() + 6 * BLOCK, blocks.get() + 4 * BLOCK, BLOCK);
+
+  // Read everything back out of order, with the second request reaching
+  // past the end of the file.
+  auto content = File::allocate_aligned_block(9 * BLOCK);
+  file->read_blocks({{4 * BLOCK, 4 * BLOCK, content.get() + 4 * BLOCK},
+                     {8 * BLOCK, BLOCK, content.get() + 8 * BLOCK},
+                     {0, 2 * BLOCK, content.get()},
+                     {2 * BLOCK, 2 * BLOCK, content.get() + 2 * BLOCK}});
+  ASSERT_EQ(0, std::memcmp(expected.data(), content.get(), 8 * BLOCK));
+}
+
+INSTANTIATE_TEST_CASE_P(PosixFileTest, PosixFileTest,
+                        ::testing::Values(File::BUFFERED, File::SYNC,
+                                          File::DIRECT));
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <numeric>
+#include <vector>
+
+#include "storage/test_file.h"
+
+namespace {
+
+using buzzdb::File;
+using buzzdb::TestFile;
+
+constexpr size_t CHUNK_SIZE = TestFile::CHUNK_SIZE;
+
+TEST(TestFileTest, ReadWriteAcrossChunks) {
+  std::vector<char> block(CHUNK_SIZE + 1000);
+  std::iota(block.begin(), block.end(), 0);
+  TestFile file;
+  file.resize(3 * CHUNK_SIZE);
+  file.write_block(block.data(), CHUNK_SIZE - 500, block.size());
+
+  std::vector<char> content(block.size());
+  file.read_block(CHUNK_SIZE - 500, content.size(), content.data());
+  ASSERT_EQ(block, content);
+  std::vector<char> expected(3 * CHUNK_SIZE, 0);
+  std::memcpy(expected.data() + CHUNK_SIZE - 500, block.data(), block.size());
+  ASSERT_EQ(expected, file.get_content());
+  ASSERT_THROW(file.write_block(block.data(), 2 * CHUNK_SIZE, block.size()), std::exception);
+  ASSERT_THROW(file.read_block(2 * CHUNK_SIZE, block.size(), content.data()), std::exception);
+}
+
+TEST(TestFileTest, Views) {
+  std::vector<char> block(10000);
+  std::iota(block.begin(), block.end(), 0);
+  TestFile file;
+  ASSERT_EQ(nullptr, file.view_block(0, 1));
+  file.resize(2 * CHUNK_SIZE);
+  file.write_block(block.data(), 0, block.size());
+
+  const char* view = file.view_block(100, 200);
+  ASSERT_NE(nullptr, view);
+  ASSERT_EQ(0, std::memcmp(block.data() + 100, view, 200));
+
+  // Views reflect later writes and are not available across chunks.
+  char zeros[200] = {};
+  file.write_block(zeros, 100, sizeof(zeros));
+  ASSERT_EQ(0, std::memcmp(zeros, view, sizeof(zeros)));
+  ASSERT_EQ(nullptr, file.view_block(CHUNK_SIZE - 1, 2));
+  ASSERT_NE(nullptr, file.view_block(CHUNK_SIZE, CHUNK_SIZE));
+  ASSERT_EQ(nullptr, file.view_block(CHUNK_SIZE, CHUNK_SIZE + 1));
+}
+
+TEST(TestFileTest, Resize) {
+  TestFile file;
+  std::vector<char> block(5000, 'a');
+  // Grows in small steps, then past the first chunk.
+  for (size_t size = 1; size <= block.size(); size++) {
+    file.resize(size);
+    file.write_block(block.data(), size - 1, 1);
+  }
+  file.resize(CHUNK_SIZE + block.size());
+  file.write_block(block.data(), CHUNK_SIZE, block.size());
+  std::vector<char> expected(CHUNK_SIZE + block.size(), 0);
+  std::fill(expected.begin(), expected.begin() + block.size(), 'a');
+  std::fill(expected.end() - block.size(), expected.end(), 'a');
+  ASSERT_EQ(expected, file.get_content());
+
+  // Growing again after shrinking appends zeros.
+  file.resize(10);
+  file.resize(20);
+  std::vector<char> content(20);
+  file.read_block(0, content.size(), content.data());
+  expected.assign(20, 0);
+  std::fill(expected.begin(), expected.begin() + 10, 'a');
+  ASSERT_EQ(expected, content);
+  file.resize(0);
+  ASSERT_EQ(0, file.size());
+}
+
+TEST(TestFileTest, ReadOnlyAndCopies) {
+  TestFile file{std::vector<char>(100, 'a')};
+  ASSERT_EQ(File::READ, file.get_mode());
+  char byte = 'b';
+  ASSERT_THROW(file.write_block(&byte, 0, 1), std::exception);
+  ASSERT_THROW(file.resize(10), std::exception);
+
+  // Copies do not share the content.
+  TestFile writable{std::vector<char>(100, 'a'), File::WRITE};
+  TestFile copy = writable;
+  writable.write_block(&byte, 0, 1);
+  ASSERT_EQ(std::vector<char>(100, 'a'), copy.get_content());
+  copy = writable;
+  ASSERT_EQ(writable.get_content(), copy.get_content());
+}
+
+TEST(TestFileTest, DeviceModel) {
+  TestFile file;
+  file.resize(1 << 20);
+  TestFile::DeviceModel device;
+  device.latency = std::chrono::milliseconds(1);
+  device.bandwidth = 1 << 30;
+  file.set_device_model(device);
+
+  // 10 requests of 1 MiB take at least 10 * (1 ms + 1/1024 s).
+  std::vector<char> block(1 << 20);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < 5; i++) {
+    file.write_block(block.data(), 0, block.size());
+    file.read_block(0, block.size(), block.data());
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  ASSERT_GE(elapsed, std::chrono::microseconds(10 * (1000 + 976)));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
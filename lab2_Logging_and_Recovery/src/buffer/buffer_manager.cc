@@ -1,6 +1,10 @@
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "buffer/buffer_manager.h"
 #include "common/macros.h"
@@ -8,7 +12,8 @@
 #include "storage/slotted_page.h"
 
 /*
-This is a dummy implementation of a buffer manager. It does not do any locking.
+This is a simple implementation of a buffer manager. It does not do any locking.
+Pages are found through a hash table, and unfixed pages are evicted with 2Q.
  */
 
 namespace buzzdb {
@@ -20,25 +25,33 @@ char* BufferFrame::get_data() {
 
 BufferManager::BufferManager(size_t page_size, size_t page_count) {
 	capacity_ = page_count;
-	page_counter_ = 0;
 	page_size_ = page_size;
 
 	pool_.resize(capacity_);
+	page_table_.reserve(capacity_);
 	for (size_t frame_id = 0; frame_id < capacity_; frame_id++) {
 		pool_[frame_id].reset(new BufferFrame());
 		pool_[frame_id]->data.resize(page_size_);
 		pool_[frame_id]->page_id = INVALID_PAGE_ID;
 		pool_[frame_id]->frame_id = frame_id;
+		pool_[frame_id]->dirty = false;
+		pool_[frame_id]->prev_frame = INVALID_FRAME_ID;
+		pool_[frame_id]->next_frame = INVALID_FRAME_ID;
+	}
+	fifo_list_ = {INVALID_FRAME_ID, INVALID_FRAME_ID, 0};
+	lru_list_ = {INVALID_FRAME_ID, INVALID_FRAME_ID, 0};
+	// The sizes suggested for 2Q by Johnson and Shasha.
+	fifo_capacity_ = std::max<size_t>(capacity_ / 4, 1);
+	ghost_capacity_ = std::max<size_t>(capacity_ / 2, 1);
+	// Hand out the frames in order.
+	for (size_t frame_id = capacity_; frame_id > 0; frame_id--) {
+		free_frames_.push_back(frame_id - 1);
 	}
 
 }
 
 BufferManager::~BufferManager() {
-	for (size_t frame_id = 0; frame_id < capacity_; frame_id++) {
-		if (pool_[frame_id]->dirty == true) {
-			write_frame(frame_id);
-		}
-	}
+	flush_all_pages();
 }
 
 BufferFrame& BufferManager::fix_page(uint64_t page_id, bool /*exclusive*/) {
@@ -53,26 +66,153 @@ BufferFrame& BufferManager::fix_page(uint64_t page_id, bool /*exclusive*/) {
 	/// Check if page is in buffer
 	uint64_t page_frame_id = get_frame_id_of_page(page_id);
 	if (page_frame_id != INVALID_FRAME_ID) {
-		return *pool_[page_frame_id];
+		auto& frame = *pool_[page_frame_id];
+		frame.fix_count++;
+		if (frame.in_lru) {
+			remove(lru_list_, page_frame_id);
+			push_back(lru_list_, page_frame_id);
+		}
+		return frame;
 	}
 
 //	std::cout << "Create page: " << page_id << "\n";
 
-	// Create a new page
-	uint64_t free_frame_id = page_counter_++;
+	// A page that is fixed again after it left the FIFO list is hot. Look it
+	// up before the eviction adds another page to the ghost list. It is
+	// forgotten, so that it goes through the FIFO list again once it is
+	// evicted from the LRU list.
+	bool hot = remove_ghost(page_id);
+
+	// Load the page into a free frame
+	uint64_t free_frame_id = get_free_frame();
+	auto& frame = *pool_[free_frame_id];
+	frame.page_id = page_id;
+	frame.dirty = false;
+	frame.fix_count = 1;
+	frame.in_lru = hot;
+	push_back(frame.in_lru ? lru_list_ : fifo_list_, free_frame_id);
+	page_table_[page_id] = free_frame_id;
 
-	if(page_counter_ >= capacity_){
-		std::cout << "Out of space \n";
-		std::cout << page_counter_ << " " << capacity_ << "\n";
-		exit(-1);
+	read_frame(free_frame_id);
+
+	return frame;
+}
+
+uint64_t BufferManager::get_free_frame() {
+
+	if (!free_frames_.empty()) {
+		uint64_t frame_id = free_frames_.back();
+		free_frames_.pop_back();
+		return frame_id;
+	}
+
+	/// 2Q: evict the oldest unfixed page of the FIFO list while it is longer
+	/// than its capacity, otherwise the least recently used unfixed page.
+	/// Only when all pages of that list are fixed, evict from the other.
+	FrameList* first = &lru_list_;
+	FrameList* second = &fifo_list_;
+	if (fifo_list_.size > fifo_capacity_) {
+		std::swap(first, second);
+	}
+	for (FrameList* list : {first, second}) {
+		uint64_t frame_id = list->head;
+		while (frame_id != INVALID_FRAME_ID && pool_[frame_id]->fix_count > 0) {
+			frame_id = pool_[frame_id]->next_frame;
+		}
+		if (frame_id == INVALID_FRAME_ID) {
+			continue;
+		}
+
+		auto& frame = *pool_[frame_id];
+		if (frame.dirty) {
+			write_frame(frame_id, false);
+		}
+		remove(*list, frame_id);
+		page_table_.erase(frame.page_id);
+		if (!frame.in_lru) {
+			add_ghost(frame.page_id);
+		}
+		return frame_id;
 	}
 
-	pool_[free_frame_id]->page_id = page_id;
-	pool_[free_frame_id]->dirty = false;
+	throw buffer_full_error();
+}
+
+void BufferManager::add_ghost(uint64_t page_id) {
 
-	read_frame(free_frame_id);
+	ghost_pages_[page_id] = ghost_list_.insert(ghost_list_.end(), page_id);
+	if (ghost_list_.size() > ghost_capacity_) {
+		ghost_pages_.erase(ghost_list_.front());
+		ghost_list_.pop_front();
+	}
+}
+
+bool BufferManager::remove_ghost(uint64_t page_id) {
+
+	auto it = ghost_pages_.find(page_id);
+	if (it == ghost_pages_.end()) {
+		return false;
+	}
+	ghost_list_.erase(it->second);
+	ghost_pages_.erase(it);
+	return true;
+}
+
+void BufferManager::push_back(FrameList& list, uint64_t frame_id) {
+
+	auto& frame = *pool_[frame_id];
+	frame.prev_frame = list.tail;
+	frame.next_frame = INVALID_FRAME_ID;
+	if (list.tail == INVALID_FRAME_ID) {
+		list.head = frame_id;
+	} else {
+		pool_[list.tail]->next_frame = frame_id;
+	}
+	list.tail = frame_id;
+	list.size++;
+}
+
+void BufferManager::remove(FrameList& list, uint64_t frame_id) {
+
+	auto& frame = *pool_[frame_id];
+	if (frame.prev_frame == INVALID_FRAME_ID) {
+		list.head = frame.next_frame;
+	} else {
+		pool_[frame.prev_frame]->next_frame = frame.next_frame;
+	}
+	if (frame.next_frame == INVALID_FRAME_ID) {
+		list.tail = frame.prev_frame;
+	} else {
+		pool_[frame.next_frame]->prev_frame = frame.prev_frame;
+	}
+	frame.prev_frame = INVALID_FRAME_ID;
+	frame.next_frame = INVALID_FRAME_ID;
+	list.size--;
+}
+
+std::vector<uint64_t> BufferManager::get_page_ids(const FrameList& list) const {
 
-	return *pool_[free_frame_id];
+	std::vector<uint64_t> page_ids;
+	for (uint64_t frame_id = list.head; frame_id != INVALID_FRAME_ID;
+			frame_id = pool_[frame_id]->next_frame) {
+		page_ids.push_back(pool_[frame_id]->page_id);
+	}
+	return page_ids;
+}
+
+void BufferManager::reset_frame(uint64_t frame_id) {
+
+	auto& frame = *pool_[frame_id];
+	if (frame.page_id != INVALID_PAGE_ID) {
+		remove(frame.in_lru ? lru_list_ : fifo_list_, frame_id);
+		page_table_.erase(frame.page_id);
+		free_frames_.push_back(frame_id);
+	}
+	frame.page_id = INVALID_PAGE_ID;
+	frame.dirty = false;
+	frame.fix_count = 0;
+	frame.in_lru = false;
+	std::fill(frame.data.begin(), frame.data.end(), 0);
 }
 
 void BufferManager::read_frame(uint64_t frame_id) {
@@ -81,18 +221,33 @@ void BufferManager::read_frame(uint64_t frame_id) {
 	auto file_handle =
 			File::open_file(std::to_string(segment_id).c_str(), File::WRITE);
 	size_t start = get_segment_page_id(pool_[frame_id]->page_id) * page_size_;
-	
-	file_handle->read_block(start, page_size_, pool_[frame_id]->data.data());
+
+	// Pages past the end of the segment are not read at all and must not keep
+	// the content of an evicted page.
+	auto& data = pool_[frame_id]->data;
+	std::fill(data.begin(), data.end(), 0);
+	file_handle->read_block(start, page_size_, data.data());
 }
 
-void BufferManager::write_frame(uint64_t frame_id) {
+void BufferManager::write_frame(uint64_t frame_id, bool sync) {
 
 	auto segment_id = get_segment_id(pool_[frame_id]->page_id);
 	auto file_handle =
 			File::open_file(std::to_string(segment_id).c_str(), File::WRITE);
 	size_t start = get_segment_page_id(pool_[frame_id]->page_id) * page_size_;
 
+	// The undo records of uncommitted changes must reach the disk before the
+	// page does, so that recovery can roll them back.
+	if (flush_log_) {
+		flush_log_();
+	}
 	file_handle->write_block(pool_[frame_id]->data.data(), start, page_size_);
+	// Flushed pages are synced, e.g., before a checkpoint record declares them
+	// durable. Evicted pages are synced by the next flush or checkpoint.
+	if (sync) {
+		file_handle->sync();
+	}
+	pool_[frame_id]->dirty = false;
 }
 
 void BufferManager::unfix_page(BufferFrame& page, bool is_dirty) {
@@ -100,6 +255,9 @@ void BufferManager::unfix_page(BufferFrame& page, bool is_dirty) {
 	if (!page.dirty) {
 		page.dirty = is_dirty;
 	}
+	if (page.fix_count > 0) {
+		page.fix_count--;
+	}
 
 }
 
@@ -111,7 +269,7 @@ void  BufferManager::flush_page(uint64_t page_id){
 	uint64_t page_frame_id = get_frame_id_of_page(page_id);
 	if (page_frame_id != INVALID_FRAME_ID) {
 		if (pool_[page_frame_id]->dirty == true) {
-			write_frame(page_frame_id);
+			write_frame(page_frame_id, true);
 		}
 	}
 
@@ -122,10 +280,7 @@ void  BufferManager::discard_page(uint64_t page_id){
 	/// Check if page is in buffer
 	uint64_t page_frame_id = get_frame_id_of_page(page_id);
 	if (page_frame_id != INVALID_FRAME_ID) {
-		pool_[page_frame_id].reset(new BufferFrame());
-		pool_[page_frame_id]->page_id = INVALID_PAGE_ID;
-		pool_[page_frame_id]->dirty = false;
-		pool_[page_frame_id]->data.resize(page_size_);
+		reset_frame(page_frame_id);
 	}
 
 }
@@ -134,9 +289,40 @@ void  BufferManager::flush_all_pages(){
 
 //	std::cout << "FLUSH ALL PAGES \n";
 
+	/// Group the dirty frames by segment
+	std::map<uint16_t, std::vector<uint64_t>> segment_frames;
 	for (size_t frame_id = 0; frame_id < capacity_; frame_id++) {
 		if (pool_[frame_id]->dirty == true) {
-			write_frame(frame_id);
+			auto segment_id = get_segment_id(pool_[frame_id]->page_id);
+			segment_frames[segment_id].push_back(frame_id);
+		}
+	}
+
+	if (!segment_frames.empty() && flush_log_) {
+		flush_log_();
+	}
+
+	/// Write the pages of every segment with one batched request in page
+	/// order, so that adjacent pages share a system call, and sync every
+	/// segment once
+	for (auto& [segment_id, frame_ids] : segment_frames) {
+		std::sort(frame_ids.begin(), frame_ids.end(),
+				[&](uint64_t left, uint64_t right) {
+					return pool_[left]->page_id < pool_[right]->page_id;
+				});
+		std::vector<File::WriteRequest> requests;
+		requests.reserve(frame_ids.size());
+		for (auto frame_id : frame_ids) {
+			size_t start = get_segment_page_id(pool_[frame_id]->page_id) * page_size_;
+			requests.push_back({pool_[frame_id]->data.data(), start, page_size_});
+		}
+
+		auto file_handle =
+				File::open_file(std::to_string(segment_id).c_str(), File::WRITE);
+		file_handle->write_blocks(requests);
+		file_handle->sync();
+		for (auto frame_id : frame_ids) {
+			pool_[frame_id]->dirty = false;
 		}
 	}
 
@@ -147,36 +333,28 @@ void  BufferManager::discard_all_pages(){
 //	std::cout << "DISCARD ALL PAGES \n";
 
 	for (size_t frame_id = 0; frame_id < capacity_; frame_id++) {
-		pool_[frame_id].reset(new BufferFrame());
-		pool_[frame_id]->page_id = INVALID_PAGE_ID;
-		pool_[frame_id]->dirty = false;
-		pool_[frame_id]->data.resize(page_size_);
+		reset_frame(frame_id);
 	}
 
 }
 
 uint64_t BufferManager::get_frame_id_of_page(uint64_t page_id){
 
-	uint64_t page_frame_id = INVALID_FRAME_ID;
-
-	for (size_t frame_id = 0; frame_id < capacity_; frame_id++) {
-		if (pool_[frame_id]->page_id == page_id) {
-			page_frame_id = frame_id;
-			break;
-		}
+	auto it = page_table_.find(page_id);
+	if (it == page_table_.end()) {
+		return INVALID_FRAME_ID;
 	}
-
-	return page_frame_id;
+	return it->second;
 }
 
 
 std::vector<uint64_t> BufferManager::get_fifo_list() const {
-	return {};
+	return get_page_ids(fifo_list_);
 }
 
 
 std::vector<uint64_t> BufferManager::get_lru_list() const {
-	return {};
+	return get_page_ids(lru_list_);
 }
 
 }  // namespace buzzdb
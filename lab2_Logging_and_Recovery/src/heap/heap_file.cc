@@ -163,8 +163,11 @@ TID HeapSegment::allocate(uint32_t record_size) {
 		BufferFrame &frame = buffer_manager_.fix_page(page_id, true);
 
 		auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
+		// The page may have been evicted and loaded into another frame.
+		page->header.buffer_frame = frame.get_data();
 
 		if(record_size > page->header.free_space){
+			buffer_manager_.unfix_page(frame, false);
 			continue;
 		}
 
@@ -203,6 +206,7 @@ uint32_t HeapSegment::read(TID tid, std::byte* record, uint32_t capacity) const
 
   BufferFrame& frame = buffer_manager_.fix_page(overall_page_id, false);
   auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
+  page->header.buffer_frame = frame.get_data();
 
 //  std::cout << *page;
 
@@ -234,6 +238,7 @@ uint32_t HeapSegment::write(TID tid, std::byte* record, uint32_t record_size, UN
 
   BufferFrame& frame = buffer_manager_.fix_page(overall_page_id, true);
   auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
+  page->header.buffer_frame = frame.get_data();
 
   buzzdb::SlottedPage::Slot slot = page->getSlot(slot_id);
   uint64_t value = slot.value;
@@ -248,11 +253,12 @@ uint32_t HeapSegment::write(TID tid, std::byte* record, uint32_t record_size, UN
   // update
   memcpy(&frame.get_data()[offset], record, record_size);
 
-  buffer_manager_.unfix_page(frame, true);
-
-  // Add an update record
+  // Add an update record while the page is fixed, so that it cannot be
+  // written back before its log record exists
   log_manager_.log_update(txn_id, overall_page_id, record_size, offset, reinterpret_cast<std::byte *> (before_record.data()), record);
 
+  buffer_manager_.unfix_page(frame, true);
+
   return 0;
 }
 
@@ -269,10 +275,11 @@ std::ostream &operator<<(std::ostream &os, HeapSegment const &s) {
 		BufferFrame &frame = s.buffer_manager_.fix_page(page_id, true);
 
 		auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
+		page->header.buffer_frame = frame.get_data();
 
 		os << *page;
 
-		s.buffer_manager_.unfix_page(frame, true);
+		s.buffer_manager_.unfix_page(frame, false);
 	}
 
   return os;
@@ -3,6 +3,8 @@
 #include <cstddef>
 #include <cstdint>
 #include <exception>
+#include <functional>
+#include <list>
 #include <unordered_map>
 #include <vector>
 #include <memory>
@@ -20,6 +22,17 @@ private:
 
 	bool dirty;
 
+    /// Number of `fix_page()` calls that were not unfixed yet. Only frames
+    /// that are not fixed can be evicted.
+    size_t fix_count = 0;
+
+    /// Whether the page is in the LRU list instead of the FIFO list.
+    bool in_lru = false;
+
+    /// Neighbours in the FIFO or LRU list, or `INVALID_FRAME_ID` at its ends.
+    uint64_t prev_frame;
+    uint64_t next_frame;
+
 public:
     /// Returns a pointer to this page's data.
     char* get_data();
@@ -53,8 +66,11 @@ public:
     /// Returns a reference to a `BufferFrame` object for a given page id. When
     /// the page is not loaded into memory, it is read from disk. Otherwise the
     /// loaded page is used.
-    /// When the page cannot be loaded because the buffer is full, throws the
-    /// exception `buffer_full_error`.
+    /// When the buffer is full, an unfixed page is evicted with the 2Q
+    /// policy and written back first if it is dirty. When all pages are
+    /// fixed, throws the exception `buffer_full_error`. A page that was
+    /// evicted from the FIFO list recently is loaded into the LRU list, all
+    /// others into the FIFO list.
     /// Is thread-safe w.r.t. other concurrent calls to `fix_page()` and
     /// `unfix_page()`.
     /// @param[in] page_id   Page id of the page that should be loaded.
@@ -97,6 +113,13 @@ public:
         return (static_cast<uint64_t>(segment_id) << 48) | segment_page_id;
     }
 
+    /// Sets a function that forces the log to disk. It is called before
+    /// dirty pages are written back, so that the log records of their
+    /// changes are durable first (write-ahead logging).
+    void set_flush_log(std::function<void()> flush_log) {
+        flush_log_ = std::move(flush_log);
+    }
+
     void  flush_page(uint64_t page_id);
 
     void  discard_page(uint64_t page_id);
@@ -117,11 +140,71 @@ private:
 
     std::vector<std::unique_ptr<BufferFrame>> pool_;
 
-    uint64_t page_counter_ = 0;
+    /// Maps the ids of the pages in the buffer to their frames.
+    std::unordered_map<uint64_t, uint64_t> page_table_;
+
+    /// Forces the log before pages are written back, see `set_flush_log()`.
+    std::function<void()> flush_log_;
+
+    /// Frames that hold no page.
+    std::vector<uint64_t> free_frames_;
+
+    /// A doubly linked list of frames, linked through their `prev_frame` and
+    /// `next_frame`.
+    struct FrameList {
+        uint64_t head;
+        uint64_t tail;
+        size_t size;
+    };
+
+    /// 2Q: pages that were loaded for the first time, oldest first. Fixing
+    /// them again does not move them, so correlated references, e.g., of
+    /// `HeapSegment::allocate()`, do not make a page hot. They are evicted
+    /// before the pages in `lru_list_` while the list is longer than
+    /// `fifo_capacity_`, so a scan does not push out hot pages.
+    FrameList fifo_list_;
+
+    /// Pages that were re-referenced after they had left the FIFO list,
+    /// least recently used first.
+    FrameList lru_list_;
+
+    /// Length of the FIFO list above which its pages are evicted first.
+    size_t fifo_capacity_;
+
+    /// Ids of the pages most recently evicted from the FIFO list that were
+    /// not fixed again since, oldest first, and their positions in the list
+    /// for lookups. Holds at most `ghost_capacity_` ids.
+    std::list<uint64_t> ghost_list_;
+    std::unordered_map<uint64_t, std::list<uint64_t>::iterator> ghost_pages_;
+    size_t ghost_capacity_;
+
+    /// Returns a frame for a new page, either a free one or one whose page
+    /// is evicted. Throws `buffer_full_error` when all frames are fixed.
+    uint64_t get_free_frame();
+
+    /// Remembers a page that was evicted from the FIFO list.
+    void add_ghost(uint64_t page_id);
+
+    /// Forgets a page of the ghost list, returns whether it was in it.
+    bool remove_ghost(uint64_t page_id);
+
+    /// Appends a frame to a list.
+    void push_back(FrameList& list, uint64_t frame_id);
+
+    /// Removes a frame from a list.
+    void remove(FrameList& list, uint64_t frame_id);
+
+    /// Returns the page ids in a list from head to tail.
+    std::vector<uint64_t> get_page_ids(const FrameList& list) const;
+
+    /// Removes the page of a frame from the buffer without writing it.
+    void reset_frame(uint64_t frame_id);
 
     void read_frame(uint64_t frame_id);
 
-    void write_frame(uint64_t frame_id);
+    /// Writes the page of a frame to its segment. With `sync`, the page is
+    /// durable when this returns.
+    void write_frame(uint64_t frame_id, bool sync);
 
 };
 
@@ -50,6 +50,9 @@ class LogManager {
     /// Add a log checkpoint record
     void log_checkpoint(BufferManager& buffer_manager);
 
+    /// Force all log records written so far to disk
+    void flush();
+
     /// recovery
     void recovery(BufferManager& buffer_manager);
 
@@ -71,6 +74,9 @@ class LogManager {
     // offset in the file
     size_t current_offset_ = 0;
 
+    // offset up to which the log is durable
+    size_t synced_offset_ = 0;
+
     std::map<uint64_t, uint64_t> txn_id_to_first_log_record;
 
     std::map<LogRecordType, uint64_t> log_record_type_to_count;
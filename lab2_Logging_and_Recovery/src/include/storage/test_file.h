@@ -1,31 +1,59 @@
 #pragma once
 
+#include <chrono>
+#include <cstddef>
+#include <memory>
 #include <vector>
 
 #include "storage/file.h"
 
 namespace buzzdb {
 
+/// An in-memory file for tests and benchmarks. The content is stored in
+/// chunks of `CHUNK_SIZE` bytes, so `resize()` never moves the content of
+/// full chunks, and `view_block()` returns pointers into the chunks
+/// instead of copying. Only the last chunk grows geometrically until it is
+/// full.
+///
+/// Optionally, every request is delayed like on a device with the given
+/// latency and bandwidth, see `DeviceModel`.
 class TestFile : public File {
- private:
-  Mode mode;
-  std::vector<char> file_content;
-
  public:
-  explicit TestFile(Mode mode = WRITE) : mode(mode) {}
-
-  explicit TestFile(std::vector<char>&& file_content, Mode mode = READ)
-      : mode(mode), file_content(std::move(file_content)) {}
-
-  TestFile(const TestFile&) = default;
+  /// Size of a chunk in bytes. Views of blocks that span two chunks are not
+  /// available.
+  static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+  /// The simulated cost of requests. A request of `size` bytes takes
+  /// `latency + size / bandwidth`. Requests of different threads overlap,
+  /// like on a device with several queues. Short delays are rounded up by
+  /// the timer slack of the operating system.
+  struct DeviceModel {
+    /// Delay of every request.
+    std::chrono::nanoseconds latency{0};
+    /// Bytes per second, or 0 for an unlimited bandwidth.
+    size_t bandwidth = 0;
+  };
+
+  /// Constructor of an empty file.
+  explicit TestFile(Mode mode = WRITE);
+
+  /// Constructor of a file with the given content.
+  explicit TestFile(std::vector<char>&& file_content, Mode mode = READ);
+
+  /// Copies the content.
+  TestFile(const TestFile& other);
   TestFile(TestFile&&) = default;
 
   ~TestFile() override = default;
 
-  TestFile& operator=(const TestFile&) = default;
+  TestFile& operator=(const TestFile& other);
   TestFile& operator=(TestFile&&) = default;
 
-  std::vector<char>& get_content() { return file_content; }
+  /// Returns a copy of the content.
+  std::vector<char> get_content() const;
+
+  /// Delays all later requests like `device`.
+  void set_device_model(const DeviceModel& device) { device_model = device; }
 
   Mode get_mode() const override;
 
@@ -33,9 +61,31 @@ class TestFile : public File {
 
   void resize(size_t new_size) override;
 
-  void read_block(size_t offset, size_t size, char* block);
+  void read_block(size_t offset, size_t size, char* block) override;
 
-  void write_block(const char* block, size_t offset, size_t size);
+  const char* view_block(size_t offset, size_t size) override;
+
+  void write_block(const char* block, size_t offset, size_t size) override;
+
+  void sync() override;
+
+ private:
+  /// A chunk and the number of bytes allocated for it. Every chunk but the
+  /// last one has `CHUNK_SIZE` bytes. Bytes past the end of the file are
+  /// zero.
+  struct Chunk {
+    std::unique_ptr<char[]> data;
+    size_t capacity = 0;
+  };
+
+  /// Throws if `offset + size` is larger than the file, then waits as long
+  /// as the simulated device needs for `size` bytes.
+  void start_request(size_t offset, size_t size, const char* error) const;
+
+  Mode mode;
+  size_t file_size = 0;
+  std::vector<Chunk> chunks;
+  DeviceModel device_model;
 };
 
 }  // namespace buzzdb
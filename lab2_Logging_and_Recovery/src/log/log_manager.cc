@@ -70,7 +70,7 @@ uint64_t LogManager::get_total_log_records_of_type(LogRecordType type) {
 /**
  * Increment the ABORT_RECORD count.
  * Rollback the provided transaction.
- * Add abort log record to the log file.
+ * Add abort log record to the log file and force it to disk.
  * Remove from the active transactions.
  */
 void LogManager::log_abort(uint64_t txn_id, BufferManager& buffer_manager) {
@@ -81,13 +81,15 @@ void LogManager::log_abort(uint64_t txn_id, BufferManager& buffer_manager) {
     record.txn_id = txn_id;
     
     write_log_record(record);
+    flush();
     active_txns_.erase(txn_id);
     log_record_type_to_count[LogRecordType::ABORT_RECORD]++;
 }
 
 /**
  * Increment the COMMIT_RECORD count
- * Add commit log record to the log file
+ * Add commit log record to the log file and force it to disk, a
+ * transaction is committed only once its commit record is durable
  * Remove from the active transactions
  */
 void LogManager::log_commit(uint64_t txn_id) {
@@ -96,10 +98,23 @@ void LogManager::log_commit(uint64_t txn_id) {
     record.txn_id = txn_id;
     
     write_log_record(record);
+    flush();
     active_txns_.erase(txn_id);
     log_record_type_to_count[LogRecordType::COMMIT_RECORD]++;
 }
 
+/**
+ * Sync the log file, unless no records were added since the last sync.
+ * Called before dirty pages are written back, so that their undo records
+ * are durable first
+ */
+void LogManager::flush() {
+    if (synced_offset_ < current_offset_) {
+        log_file_->sync();
+        synced_offset_ = current_offset_;
+    }
+}
+
 /**
  * Increment the UPDATE_RECORD count
  * Add the update log record to the log file
@@ -150,7 +165,7 @@ void LogManager::log_txn_begin(uint64_t txn_id) {
 /**
  * Increment the CHECKPOINT_RECORD count
  * Flush all dirty pages to the disk (USE: buffer_manager.flush_all_pages())
- * Add the checkpoint log record to the log file
+ * Add the checkpoint log record to the log file and force it to disk
  */
 void LogManager::log_checkpoint(BufferManager& buffer_manager) {
     buffer_manager.flush_all_pages();
@@ -165,6 +180,7 @@ void LogManager::log_checkpoint(BufferManager& buffer_manager) {
     }
     
     write_log_record(record);
+    flush();
     log_record_type_to_count[LogRecordType::CHECKPOINT_RECORD]++;
 }
 
@@ -296,36 +312,28 @@ void LogManager::rollback_txn(uint64_t txn_id, BufferManager& buffer_manager) {
 }
 
 void LogManager::write_log_record(const LogRecord& record) {
-    // Write log record type
-    log_file_->write_block(reinterpret_cast<const char*>(&record.type), 
-                          current_offset_, sizeof(LogRecordType));
-    current_offset_ += sizeof(LogRecordType);
-    
-    // Write transaction ID
-    log_file_->write_block(reinterpret_cast<const char*>(&record.txn_id), 
-                          current_offset_, sizeof(uint64_t));
-    current_offset_ += sizeof(uint64_t);
+    // Gather the fields of the record, which are stored back to back, and
+    // write them with a single request
+    std::vector<File::WriteRequest> requests;
+    auto add_field = [&](const char* data, size_t size) {
+        requests.push_back({data, current_offset_, size});
+        current_offset_ += size;
+    };
+
+    // Log record type and transaction ID
+    add_field(reinterpret_cast<const char*>(&record.type), sizeof(LogRecordType));
+    add_field(reinterpret_cast<const char*>(&record.txn_id), sizeof(uint64_t));
     
     if (record.type == LogRecordType::UPDATE_RECORD) {
-        // Write update-specific fields
-        log_file_->write_block(reinterpret_cast<const char*>(&record.page_id), 
-                              current_offset_, sizeof(uint64_t));
-        current_offset_ += sizeof(uint64_t);
-        
-        log_file_->write_block(reinterpret_cast<const char*>(&record.length), 
-                              current_offset_, sizeof(uint64_t));
-        current_offset_ += sizeof(uint64_t);
-        
-        log_file_->write_block(reinterpret_cast<const char*>(&record.offset), 
-                              current_offset_, sizeof(uint64_t));
-        current_offset_ += sizeof(uint64_t);
-        
-        log_file_->write_block(record.before_img.get(), current_offset_, record.length);
-        current_offset_ += record.length;
-        
-        log_file_->write_block(record.after_img.get(), current_offset_, record.length);
-        current_offset_ += record.length;
+        // Update-specific fields
+        add_field(reinterpret_cast<const char*>(&record.page_id), sizeof(uint64_t));
+        add_field(reinterpret_cast<const char*>(&record.length), sizeof(uint64_t));
+        add_field(reinterpret_cast<const char*>(&record.offset), sizeof(uint64_t));
+        add_field(record.before_img.get(), record.length);
+        add_field(record.after_img.get(), record.length);
     }
+
+    log_file_->write_blocks(requests);
 }
 
 LogRecord LogManager::read_log_record(uint64_t offset) {
@@ -1,12 +1,18 @@
 
 #include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>  // NOLINT
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cerrno>
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <system_error>
+#include <vector>
 
 #include "storage/file.h"
 
@@ -24,6 +30,9 @@ class PosixFile : public File {
  private:
   Mode mode;
   int fd;
+  /// Descriptor opened with `O_DIRECT` for aligned requests in `DIRECT`
+  /// mode, or -1.
+  int direct_fd = -1;
   size_t cached_size;
 
   size_t read_size() {
@@ -34,21 +43,98 @@ class PosixFile : public File {
     return file_stat.st_size;
   }
 
- public:
-  PosixFile(Mode mode, int fd, size_t size)
-      : mode(mode), fd(fd), cached_size(size) {}
+  /// Returns the descriptor that should serve a request. Unaligned
+  /// requests cannot use `O_DIRECT` and go through the page cache instead.
+  /// Linux keeps both paths coherent.
+  int request_fd(size_t offset, size_t size, const char* block) const {
+    if (direct_fd >= 0 &&
+        (offset | size | reinterpret_cast<uintptr_t>(block)) %
+                DIRECT_IO_ALIGNMENT ==
+            0) {
+      return direct_fd;
+    }
+    return fd;
+  }
+
+  /// Serves `requests` with one `transfer()` call, i.e., `preadv()` or
+  /// `pwritev()`, per group of adjacent blocks. Like `read_block()` and
+  /// `write_block()`, a group stops early when `transfer()` makes no
+  /// progress, e.g., when reading past the end of the file.
+  template <typename Request, typename Transfer>
+  void transfer_blocks(const std::vector<Request>& requests,
+                       Transfer&& transfer) {
+    std::vector<struct ::iovec> iovecs;
+    size_t first = 0;
+    while (first < requests.size()) {
+      size_t offset = requests[first].offset;
+      size_t end = offset;
+      bool aligned = direct_fd >= 0 && offset % DIRECT_IO_ALIGNMENT == 0;
+      iovecs.clear();
+      for (; first < requests.size() && requests[first].offset == end &&
+             iovecs.size() < IOV_MAX;
+           ++first) {
+        auto& request = requests[first];
+        auto* block = const_cast<char*>(request.block);
+        iovecs.push_back({block, request.size});
+        end += request.size;
+        uintptr_t address = reinterpret_cast<uintptr_t>(block);
+        aligned = aligned &&
+                  (request.size | address) % DIRECT_IO_ALIGNMENT == 0;
+      }
 
-  PosixFile(const char* filename, Mode mode) : mode(mode) {
+      int transfer_fd = aligned ? direct_fd : fd;
+      size_t index = 0;
+      while (index < iovecs.size()) {
+        ssize_t bytes = transfer(transfer_fd, iovecs.data() + index,
+                                 static_cast<int>(iovecs.size() - index),
+                                 static_cast<off_t>(offset));
+        if (bytes < 0) {
+          throw_errno();
+        }
+        if (bytes == 0) {
+          break;
+        }
+        offset += bytes;
+        // Skip what was transferred. The rest of a partially transferred
+        // group is unaligned in general, so it goes through the page cache.
+        transfer_fd = fd;
+        size_t remaining = static_cast<size_t>(bytes);
+        while (index < iovecs.size() && remaining >= iovecs[index].iov_len) {
+          remaining -= iovecs[index].iov_len;
+          ++index;
+        }
+        if (remaining > 0) {
+          iovecs[index].iov_base =
+              static_cast<char*>(iovecs[index].iov_base) + remaining;
+          iovecs[index].iov_len -= remaining;
+        }
+      }
+    }
+  }
+
+ public:
+  PosixFile(const char* filename, Mode mode, IOMode io_mode) : mode(mode) {
+    int flags = io_mode == SYNC ? O_SYNC : 0;
     switch (mode) {
       case READ:
-        fd = ::open(filename, O_RDONLY | O_SYNC);
+        flags |= O_RDONLY;
         break;
       case WRITE:
-        fd = ::open(filename, O_RDWR | O_CREAT | O_SYNC, 0666);
+        flags |= O_RDWR | O_CREAT;
     }
+    fd = ::open(filename, flags, 0666);
     if (fd < 0) {
       throw_errno();
     }
+    if (io_mode == DIRECT) {
+      // File systems without O_DIRECT support (e.g., tmpfs) reject it with
+      // EINVAL, all requests go through the page cache there.
+      direct_fd = ::open(filename, flags | O_DIRECT, 0666);
+      if (direct_fd < 0 && errno != EINVAL) {
+        ::close(fd);
+        throw_errno();
+      }
+    }
     cached_size = read_size();
   }
 
@@ -57,6 +143,9 @@ class PosixFile : public File {
     // destructor. Also, even when close() fails, the fd will always be
     // freed (see man 2 close).
     ::close(fd);
+    if (direct_fd >= 0) {
+      ::close(direct_fd);
+    }
   }
 
   Mode get_mode() const override { return mode; }
@@ -76,9 +165,11 @@ class PosixFile : public File {
   void read_block(size_t offset, size_t size, char* block) override {
     size_t total_bytes_read = 0;
     while (total_bytes_read < size) {
-      ssize_t bytes_read =
-          ::pread(fd, block + total_bytes_read, size - total_bytes_read,
-                  offset + total_bytes_read);
+      ssize_t bytes_read = ::pread(
+          request_fd(offset + total_bytes_read, size - total_bytes_read,
+                     block + total_bytes_read),
+          block + total_bytes_read, size - total_bytes_read,
+          offset + total_bytes_read);
       if (bytes_read == 0) {
         // end of file, i.e. size was probably larger than the file
         // size
@@ -94,9 +185,11 @@ class PosixFile : public File {
   void write_block(const char* block, size_t offset, size_t size) override {
     size_t total_bytes_written = 0;
     while (total_bytes_written < size) {
-      ssize_t bytes_written =
-          ::pwrite(fd, block + total_bytes_written, size - total_bytes_written,
-                   offset + total_bytes_written);
+      ssize_t bytes_written = ::pwrite(
+          request_fd(offset + total_bytes_written, size - total_bytes_written,
+                     block + total_bytes_written),
+          block + total_bytes_written, size - total_bytes_written,
+          offset + total_bytes_written);
       if (bytes_written == 0) {
         // This should probably never happen. Return here to prevent
         // an infinite loop.
@@ -108,23 +201,73 @@ class PosixFile : public File {
       total_bytes_written += static_cast<size_t>(bytes_written);
     }
   }
+
+  void read_blocks(const std::vector<ReadRequest>& requests) override {
+    transfer_blocks(requests, [](int fd, const struct ::iovec* iov, int count,
+                                 off_t offset) {
+      return ::preadv(fd, iov, count, offset);
+    });
+  }
+
+  void write_blocks(const std::vector<WriteRequest>& requests) override {
+    transfer_blocks(requests, [](int fd, const struct ::iovec* iov, int count,
+                                 off_t offset) {
+      return ::pwritev(fd, iov, count, offset);
+    });
+  }
+
+  void advise(Advice advice, size_t offset, size_t size) override {
+    int fadvice = POSIX_FADV_NORMAL;
+    switch (advice) {
+      case NORMAL:
+        break;
+      case SEQUENTIAL:
+        fadvice = POSIX_FADV_SEQUENTIAL;
+        break;
+      case WILLNEED:
+        fadvice = POSIX_FADV_WILLNEED;
+        break;
+    }
+    // Failing to give a hint is not an error.
+    ::posix_fadvise(fd, offset, size, fadvice);
+  }
+
+  void sync() override {
+    // Descriptors of the same file share its page cache, so this covers the
+    // writes through `direct_fd` as well.
+    if (::fdatasync(fd) < 0) {
+      throw_errno();
+    }
+  }
 };
 
-std::unique_ptr<File> File::open_file(const char* filename, Mode mode) {
-  return std::make_unique<PosixFile>(filename, mode);
+std::unique_ptr<File> File::open_file(const char* filename, Mode mode,
+                                      IOMode io_mode) {
+  return std::make_unique<PosixFile>(filename, mode, io_mode);
 }
 
-std::unique_ptr<File> File::make_temporary_file() {
-  char file_template[] = ".tmpfile-XXXXXX";
+std::unique_ptr<File> File::make_temporary_file(IOMode io_mode,
+                                                const char* directory) {
+  std::string path = directory != nullptr ? std::string{directory} + "/" : "";
+  path += ".tmpfile-XXXXXX";
+  char* file_template = path.data();
   int fd = ::mkstemp(file_template);
   if (fd < 0) {
     throw_errno();
   }
+  ::close(fd);
+  // Reopen the file by name, so that it gets the descriptors of `io_mode`.
+  std::unique_ptr<File> file;
+  try {
+    file = std::make_unique<PosixFile>(file_template, File::WRITE, io_mode);
+  } catch (...) {
+    ::unlink(file_template);
+    throw;
+  }
   if (::unlink(file_template) < 0) {
-    ::close(fd);
     throw_errno();
   }
-  return std::make_unique<PosixFile>(File::WRITE, fd, 0);
+  return file;
 }
 
 }  // namespace buzzdb
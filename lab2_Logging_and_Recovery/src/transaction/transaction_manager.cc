@@ -21,9 +21,13 @@ TransactionManager::TransactionManager(LogManager &log_manager,
 				log_manager_(log_manager),
 				buffer_manager_(buffer_manager),
 				transaction_counter_(0){
+	// Write-ahead logging: the log is forced before dirty pages of
+	// uncommitted transactions are written back
+	buffer_manager_.set_flush_log([&log_manager]() { log_manager.flush(); });
 }
 
 TransactionManager::~TransactionManager(){
+	buffer_manager_.set_flush_log(nullptr);
 }
 
 void TransactionManager::reset(LogManager &log_manager){
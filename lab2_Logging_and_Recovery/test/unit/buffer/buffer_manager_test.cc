@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "buffer/buffer_manager.h"
+#include "common/macros.h"
+#include "storage/file.h"
+
+using buzzdb::BufferFrame;
+using buzzdb::BufferManager;
+using buzzdb::File;
+
+constexpr uint64_t SEGMENT = 124;
+constexpr size_t PAGE_SIZE = 128;
+
+namespace {
+
+class BufferManagerTest: public ::testing::Test{
+	void SetUp() {
+		auto file_handle = File::open_file(std::to_string(SEGMENT).c_str(),
+											File::WRITE);
+		file_handle->resize(0);
+	}
+};
+
+uint64_t page_id(uint64_t segment_page_id) {
+	return BufferManager::get_overall_page_id(SEGMENT, segment_page_id);
+}
+
+TEST_F(BufferManagerTest, EvictsUnfixedPages) {
+	BufferManager buffer_manager(PAGE_SIZE, 10);
+
+	// Write more pages than fit into the buffer.
+	for (uint64_t i = 0; i < 100; i++) {
+		BufferFrame& frame = buffer_manager.fix_page(page_id(i), true);
+		std::memset(frame.get_data(), static_cast<int>(i), PAGE_SIZE);
+		buffer_manager.unfix_page(frame, true);
+	}
+
+	// Evicted dirty pages were written back.
+	for (uint64_t i = 0; i < 100; i++) {
+		BufferFrame& frame = buffer_manager.fix_page(page_id(i), false);
+		std::vector<char> expected(PAGE_SIZE, static_cast<char>(i));
+		ASSERT_EQ(0, std::memcmp(expected.data(), frame.get_data(), PAGE_SIZE));
+		buffer_manager.unfix_page(frame, false);
+	}
+}
+
+TEST_F(BufferManagerTest, FixedPagesStay) {
+	BufferManager buffer_manager(PAGE_SIZE, 10);
+
+	std::vector<BufferFrame*> frames;
+	for (uint64_t i = 0; i < 10; i++) {
+		frames.push_back(&buffer_manager.fix_page(page_id(i), true));
+	}
+	ASSERT_THROW(buffer_manager.fix_page(page_id(10), true),
+			buzzdb::buffer_full_error);
+
+	// Fixing a page again returns the same frame.
+	BufferFrame& again = buffer_manager.fix_page(page_id(3), false);
+	ASSERT_EQ(frames[3], &again);
+	buffer_manager.unfix_page(again, false);
+
+	// Once a single page is unfixed, it is the only victim.
+	buffer_manager.unfix_page(*frames[5], false);
+	BufferFrame& frame = buffer_manager.fix_page(page_id(10), true);
+	ASSERT_EQ(frames[5], &frame);
+	ASSERT_EQ(buzzdb::INVALID_FRAME_ID,
+			buffer_manager.get_frame_id_of_page(page_id(5)));
+	for (uint64_t i = 0; i < 10; i++) {
+		if (i != 5) {
+			buffer_manager.unfix_page(*frames[i], false);
+		}
+	}
+	buffer_manager.unfix_page(frame, false);
+}
+
+TEST_F(BufferManagerTest, DiscardPages) {
+	BufferManager buffer_manager(PAGE_SIZE, 10);
+
+	BufferFrame& frame = buffer_manager.fix_page(page_id(0), true);
+	std::memset(frame.get_data(), 1, PAGE_SIZE);
+	buffer_manager.unfix_page(frame, true);
+	buffer_manager.flush_all_pages();
+
+	// Discarded changes are not written back, the page is reloaded.
+	BufferFrame& dirty = buffer_manager.fix_page(page_id(0), true);
+	std::memset(dirty.get_data(), 2, PAGE_SIZE);
+	buffer_manager.unfix_page(dirty, true);
+	buffer_manager.discard_all_pages();
+
+	BufferFrame& reloaded = buffer_manager.fix_page(page_id(0), false);
+	std::vector<char> expected(PAGE_SIZE, 1);
+	ASSERT_EQ(0, std::memcmp(expected.data(), reloaded.get_data(), PAGE_SIZE));
+	buffer_manager.unfix_page(reloaded, false);
+}
+
+TEST_F(BufferManagerTest, FlushLogBeforeWriteBack) {
+	BufferManager buffer_manager(PAGE_SIZE, 1);
+	size_t log_flushes = 0;
+	buffer_manager.set_flush_log([&]() { log_flushes++; });
+
+	// Evicting a clean page does not force the log.
+	buffer_manager.unfix_page(buffer_manager.fix_page(page_id(0), false), false);
+	buffer_manager.unfix_page(buffer_manager.fix_page(page_id(1), true), true);
+	ASSERT_EQ(0u, log_flushes);
+
+	// Evicting or flushing a dirty page does.
+	buffer_manager.unfix_page(buffer_manager.fix_page(page_id(2), true), true);
+	ASSERT_EQ(1u, log_flushes);
+	buffer_manager.flush_all_pages();
+	ASSERT_EQ(2u, log_flushes);
+	buffer_manager.flush_all_pages();
+	ASSERT_EQ(2u, log_flushes);
+}
+
+TEST_F(BufferManagerTest, FIFOAndLRULists) {
+	BufferManager buffer_manager(PAGE_SIZE, 10);
+
+	for (uint64_t i = 0; i < 3; i++) {
+		buffer_manager.unfix_page(buffer_manager.fix_page(page_id(i), false),
+				false);
+	}
+	// Fixing a page in the FIFO list again does not move it.
+	buffer_manager.unfix_page(buffer_manager.fix_page(page_id(1), false),
+			false);
+	std::vector<uint64_t> fifo{page_id(0), page_id(1), page_id(2)};
+	ASSERT_EQ(fifo, buffer_manager.get_fifo_list());
+	ASSERT_TRUE(buffer_manager.get_lru_list().empty());
+
+	// Pages 0 to 2 are evicted from the FIFO list.
+	for (uint64_t i = 3; i < 13; i++) {
+		buffer_manager.unfix_page(buffer_manager.fix_page(page_id(i), false),
+				false);
+	}
+	fifo.clear();
+	for (uint64_t i = 3; i < 13; i++) {
+		fifo.push_back(page_id(i));
+	}
+	ASSERT_EQ(fifo, buffer_manager.get_fifo_list());
+
+	// Fixing them again loads them into the LRU list, later fixes move them
+	// to its end.
+	for (uint64_t i : {1, 0, 1}) {
+		buffer_manager.unfix_page(buffer_manager.fix_page(page_id(i), false),
+				false);
+	}
+	fifo.erase(fifo.begin(), fifo.begin() + 2);
+	std::vector<uint64_t> lru{page_id(0), page_id(1)};
+	ASSERT_EQ(fifo, buffer_manager.get_fifo_list());
+	ASSERT_EQ(lru, buffer_manager.get_lru_list());
+}
+
+TEST_F(BufferManagerTest, LRUPagesReturnToFIFOList) {
+	BufferManager buffer_manager(PAGE_SIZE, 4);
+
+	// Page 0 is evicted from the FIFO list and fixed again.
+	for (uint64_t i : {0, 1, 2, 3, 4, 0}) {
+		buffer_manager.unfix_page(buffer_manager.fix_page(page_id(i), false),
+				false);
+	}
+	ASSERT_EQ(std::vector<uint64_t>{page_id(0)}, buffer_manager.get_lru_list());
+
+	// With all pages of the FIFO list fixed, page 0 is evicted from the LRU
+	// list.
+	std::vector<BufferFrame*> frames;
+	for (uint64_t i = 2; i < 5; i++) {
+		frames.push_back(&buffer_manager.fix_page(page_id(i), false));
+	}
+	buffer_manager.unfix_page(buffer_manager.fix_page(page_id(5), false),
+			false);
+	ASSERT_EQ(buzzdb::INVALID_FRAME_ID,
+			buffer_manager.get_frame_id_of_page(page_id(0)));
+	for (auto* frame : frames) {
+		buffer_manager.unfix_page(*frame, false);
+	}
+
+	// When it is fixed again, it goes through the FIFO list.
+	buffer_manager.unfix_page(buffer_manager.fix_page(page_id(0), false),
+			false);
+	std::vector<uint64_t> fifo{page_id(3), page_id(4), page_id(5), page_id(0)};
+	ASSERT_EQ(fifo, buffer_manager.get_fifo_list());
+	ASSERT_TRUE(buffer_manager.get_lru_list().empty());
+}
+
+TEST_F(BufferManagerTest, ScanKeepsHotPages) {
+	BufferManager buffer_manager(PAGE_SIZE, 10);
+
+	// Pages 0 to 4 are hot, they are fixed again after they were evicted.
+	for (uint64_t i : {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+			0, 1, 2, 3, 4}) {
+		buffer_manager.unfix_page(buffer_manager.fix_page(page_id(i), false),
+				false);
+	}
+	std::vector<uint64_t> lru;
+	for (uint64_t i = 0; i < 5; i++) {
+		lru.push_back(page_id(i));
+	}
+	ASSERT_EQ(lru, buffer_manager.get_lru_list());
+
+	// Repeated scans over many other pages only replace pages in the FIFO
+	// list.
+	for (size_t round = 0; round < 3; round++) {
+		for (uint64_t i = 100; i < 200; i++) {
+			buffer_manager.unfix_page(buffer_manager.fix_page(page_id(i), false),
+					false);
+		}
+		std::vector<uint64_t> fifo;
+		for (uint64_t i = 195; i < 200; i++) {
+			fifo.push_back(page_id(i));
+		}
+		ASSERT_EQ(fifo, buffer_manager.get_fifo_list());
+		ASSERT_EQ(lru, buffer_manager.get_lru_list());
+	}
+
+	// Without unfixed pages in the FIFO list, the least recently used page
+	// is evicted.
+	std::vector<BufferFrame*> frames;
+	for (uint64_t i = 195; i < 200; i++) {
+		frames.push_back(&buffer_manager.fix_page(page_id(i), false));
+	}
+	buffer_manager.unfix_page(buffer_manager.fix_page(page_id(300), false),
+			false);
+	lru = {page_id(1), page_id(2), page_id(3), page_id(4)};
+	ASSERT_EQ(lru, buffer_manager.get_lru_list());
+	std::vector<uint64_t> fifo;
+	for (uint64_t i = 195; i < 200; i++) {
+		fifo.push_back(page_id(i));
+	}
+	fifo.push_back(page_id(300));
+	ASSERT_EQ(fifo, buffer_manager.get_fifo_list());
+	for (auto* frame : frames) {
+		buffer_manager.unfix_page(*frame, false);
+	}
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
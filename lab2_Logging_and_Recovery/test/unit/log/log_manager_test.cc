@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <string>
+#include <vector>
 
 #include "heap/heap_file.h"
 #include "log/log_manager.h"
@@ -549,6 +550,44 @@ TEST_F(LogManagerTest, TestOpenCommitCheckpointOpenCrash){
 
 }
 
+/** 
+ * T1 inserts but does not commit
+ * Its dirty page is evicted by other pages
+ * crash
+ * T1 data should not be there
+*/
+
+TEST_F(LogManagerTest, TestEvictOpenCrash){
+	BufferManager buffer_manager(128, 2);
+	auto logfile = buzzdb::File::open_file(LOG_FILE, buzzdb::File::WRITE);
+	LogManager log_manager(logfile.get());
+	HeapSegment heap_segment(123, log_manager, buffer_manager);
+	TransactionManager transaction_manager(log_manager, buffer_manager);
+
+	uint64_t table_id = 101;
+	uint64_t t1 = transaction_manager.start_txn();
+	insert_row(heap_segment, transaction_manager, t1, table_id, 5);
+
+	// Steal: the buffer writes back the uncommitted page to make room
+	uint64_t heap_page_id = BufferManager::get_overall_page_id(HEAP_SEGMENT, 0);
+	std::vector<BufferFrame*> frames;
+	for (uint64_t i = 0; i < 2; i++) {
+		frames.push_back(&buffer_manager.fix_page(
+				BufferManager::get_overall_page_id(HEAP_SEGMENT + 1, i), false));
+	}
+	EXPECT_EQ(buzzdb::INVALID_FRAME_ID,
+			buffer_manager.get_frame_id_of_page(heap_page_id));
+	for (auto* frame : frames) {
+		buffer_manager.unfix_page(*frame, false);
+	}
+
+	crash(transaction_manager, buffer_manager, log_manager);
+
+	EXPECT_TRUE(look(heap_segment, transaction_manager, buffer_manager,
+			table_id, 5, false));
+
+}
+
 }  // namespace
 int main(int argc, char* argv[]) {
 	testing::InitGoogleTest(&argc, argv);
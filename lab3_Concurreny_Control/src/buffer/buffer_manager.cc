@@ -9,7 +9,6 @@
 #include <chrono>
 #include <ctime> 
 
-uint64_t wake_timeout_ = 100;
 uint64_t timeout_ = 2000; // 2 seconds timeout for deadlock detection
 
 namespace buzzdb {
@@ -20,21 +19,28 @@ BufferFrame::BufferFrame()
     : page_id(INVALID_PAGE_ID),
       frame_id(INVALID_FRAME_ID),
       dirty(false),
-      exclusive(false) {}
+      pin_count(0),
+      lock_count(0),
+      referenced(false),
+      discarded(false),
+      evicting(false) {}
 
 BufferFrame::BufferFrame(const BufferFrame& other)
     : page_id(other.page_id),
       frame_id(other.frame_id),
       data(other.data),
       dirty(other.dirty),
-      exclusive(other.exclusive) {}
+      pin_count(0),
+      lock_count(0),
+      referenced(false),
+      discarded(false),
+      evicting(false) {}
 
 BufferFrame& BufferFrame::operator=(BufferFrame other) {
   std::swap(this->page_id, other.page_id);
   std::swap(this->frame_id, other.frame_id);
   std::swap(this->data, other.data);
   std::swap(this->dirty, other.dirty);
-  std::swap(this->exclusive, other.exclusive);
   return *this;
 }
 
@@ -519,7 +525,8 @@ std::set<uint64_t> LockManager::get_page_ids_for_txn(uint64_t txn_id) {
 }
 
 // BufferManager implementation
-BufferManager::BufferManager(size_t page_size, size_t page_count) {
+BufferManager::BufferManager(size_t page_size, size_t page_count)
+    : shards_(std::max<size_t>(1, std::min(NUM_SHARDS, page_count))) {
   capacity_ = page_count;
   page_size_ = page_size;
 
@@ -528,7 +535,11 @@ BufferManager::BufferManager(size_t page_size, size_t page_count) {
     pool_[frame_id].reset(new BufferFrame());
     pool_[frame_id]->data.resize(page_size_);
     pool_[frame_id]->frame_id = frame_id;
-    free_frames_.push_back(frame_id);
+
+    // Deal the frames out to the shards
+    Shard& shard = shards_[frame_id % shards_.size()];
+    shard.frames.push_back(frame_id);
+    shard.free_frames.push_back(frame_id);
   }
 }
 
@@ -536,268 +547,499 @@ BufferManager::~BufferManager() {
   flush_all_pages();
 }
 
-size_t BufferManager::get_frame_id(uint64_t page_id) {
-  std::lock_guard<std::mutex> lock(pool_mutex_);
-  
-  auto it = page_table_.find(page_id);
-  if (it != page_table_.end()) {
-    return it->second;
+BufferManager::Shard& BufferManager::get_shard(uint64_t page_id) {
+  // Pages of a segment differ in the low bits, segments in the high bits
+  uint64_t hash = (page_id ^ (page_id >> 48)) * 0x9E3779B97F4A7C15ull;
+  return shards_[(hash >> 32) % shards_.size()];
+}
+
+size_t BufferManager::take_free_frame(Shard& from) {
+  if (from.free_frames.empty()) {
+    return INVALID_FRAME_ID;
   }
-  
-  // Page not in buffer, need to load it
-  size_t frame_id = get_free_frame();
-  
-  // Update page table
-  page_table_[page_id] = frame_id;
-  
-  // Set page ID in frame
-  pool_[frame_id]->page_id = page_id;
-  
-  // Read data from disk
-  read_frame(frame_id);
-  
+  size_t frame_id = from.free_frames.front();
+  from.free_frames.pop_front();
   return frame_id;
 }
 
-size_t BufferManager::get_free_frame() {
-  // If there are free frames, use one
-  if (!free_frames_.empty()) {
-    size_t frame_id = free_frames_.front();
-    free_frames_.pop_front();
+size_t BufferManager::evict_frame(Shard& from, PageFrame& victim) {
+  // CLOCK over the frames of the shard. Pinned frames are in use, and pages
+  // fixed by a running transaction may hold its uncommitted changes, which
+  // must not reach the disk before it commits. Two rounds clear all
+  // reference bits, so only pinned, fixed or evicting frames remain after
+  // them.
+  for (size_t step = 0; step < 2 * from.frames.size(); step++) {
+    if (from.clock_hand >= from.frames.size()) {
+      from.clock_hand = 0;
+    }
+    size_t frame_id = from.frames[from.clock_hand++];
+
+    auto& frame = *pool_[frame_id];
+    if (frame.page_id == INVALID_PAGE_ID || frame.pin_count > 0 ||
+        frame.lock_count > 0 || frame.evicting) {
+      continue;
+    }
+    if (frame.referenced) {
+      frame.referenced = false;
+      continue;
+    }
+
+    if (frame.dirty) {
+      // The caller writes the page back without the shard latch, so that
+      // fixes of other pages do not wait for the disk
+      frame.evicting = true;
+      victim = {frame_id, frame.page_id};
+      return INVALID_FRAME_ID;
+    }
+    from.page_table.erase(frame.page_id);
+    frame.page_id = INVALID_PAGE_ID;
     return frame_id;
   }
-  
-  // No free frames, need to evict one - implement victim selection policy
-  // For simplicity, just using the first frame for now
-  // In a real system, you would implement a proper replacement policy (LRU, CLOCK, etc.)
-  throw buffer_full_error(); // For now, just throw an error as eviction isn't implemented yet
+
+  return INVALID_FRAME_ID;
+}
+
+void BufferManager::evict_dirty_frame(const PageFrame& victim) {
+  // Nobody can pin or modify the page while it is evicting
+  write_frame(victim.frame_id, victim.page_id);
+
+  Shard& shard = get_shard(victim.page_id);
+  std::unique_lock<std::mutex> lock(shard.mutex);
+  shard.page_table.erase(victim.page_id);
+  // Wakes up fixes that wait for the page, too
+  free_frame(shard, lock, victim.frame_id);
+}
+
+void BufferManager::move_frame(size_t frame_id, Shard& from, Shard& to) {
+  auto it = std::find(from.frames.begin(), from.frames.end(), frame_id);
+  *it = from.frames.back();
+  from.frames.pop_back();
+  to.frames.push_back(frame_id);
+}
+
+size_t BufferManager::get_free_frame(Shard& shard, PageFrame& victim) {
+  // Other shards are only latched if they are not busy, so that two shards
+  // never wait for each other. Free frames are preferred over evictions,
+  // and evictions in the own shard over evictions in others.
+  auto take_from_others = [&](auto take) {
+    for (auto& other : shards_) {
+      if (&other == &shard) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(other.mutex, std::try_to_lock);
+      if (!lock.owns_lock()) {
+        continue;
+      }
+      size_t frame_id = take(other);
+      if (frame_id != INVALID_FRAME_ID) {
+        move_frame(frame_id, other, shard);
+        return frame_id;
+      }
+      if (victim.frame_id != INVALID_FRAME_ID) {
+        break;
+      }
+    }
+    return INVALID_FRAME_ID;
+  };
+
+  size_t frame_id = take_free_frame(shard);
+  if (frame_id == INVALID_FRAME_ID) {
+    frame_id = take_from_others([this](Shard& other) { return take_free_frame(other); });
+  }
+  if (frame_id == INVALID_FRAME_ID) {
+    frame_id = evict_frame(shard, victim);
+  }
+  if (frame_id == INVALID_FRAME_ID && victim.frame_id == INVALID_FRAME_ID) {
+    frame_id = take_from_others(
+        [this, &victim](Shard& other) { return evict_frame(other, victim); });
+  }
+  return frame_id;
 }
 
 BufferFrame& BufferManager::fix_page(uint64_t txn_id, uint64_t page_id, bool exclusive) {
-  // For shared locks (non-exclusive), multiple transactions can have them on the same page
-  // Check if the page is already in the buffer pool
-  size_t frame_id;
-  
-  {
-    std::lock_guard<std::mutex> lock(pool_mutex_);
-    auto it = page_table_.find(page_id);
-    if (it != page_table_.end()) {
-      frame_id = it->second;
-      
-      // Get the lock manager for this frame
-      LockMode mode = exclusive ? LockMode::EXCLUSIVE : LockMode::SHARED;
-      
-      // Check if we can acquire the lock without causing a deadlock
-      bool success = lock_manager_.acquire_lock(txn_id, page_id, mode);
-      if (!success) {
-        // Failed to acquire lock (e.g., deadlock detected)
-        throw transaction_abort_error();
+  // Lock the page before latching its shard. Waiting for a lock can take
+  // long and must not stall other pages of the shard.
+  LockMode mode = exclusive ? LockMode::EXCLUSIVE : LockMode::SHARED;
+  if (!lock_manager_.acquire_lock(txn_id, page_id, mode)) {
+    // Failed to acquire lock (e.g., deadlock detected)
+    throw transaction_abort_error();
+  }
+
+  // Track this page for the transaction. Its first fix keeps the page in
+  // the buffer until the transaction ends.
+  bool first_fix = false;
+  if (txn_id != INVALID_TXN_ID) {
+    std::lock_guard<std::mutex> lock(txn_pages_mutex_);
+    first_fix = txn_pages_[txn_id].insert(page_id).second;
+  }
+
+  Shard& shard = get_shard(page_id);
+  std::unique_lock<std::mutex> lock(shard.mutex);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_);
+  // Gives up on the page. The transaction did not get it, so it does not
+  // keep it in the buffer either.
+  auto fail = [&]() {
+    lock.unlock();
+    if (first_fix) {
+      std::lock_guard<std::mutex> txn_lock(txn_pages_mutex_);
+      txn_pages_[txn_id].erase(page_id);
+    }
+    throw buffer_full_error();
+  };
+  while (true) {
+    // Check if the page is already in the buffer pool
+    auto it = shard.page_table.find(page_id);
+    if (it != shard.page_table.end()) {
+      auto& frame = *pool_[it->second];
+      if (frame.evicting) {
+        // Load the page again once it is written back
+        if (shard.frame_released.wait_until(lock, deadline) == std::cv_status::timeout) {
+          fail();
+        }
+        continue;
       }
-      
-      // Track this page for the transaction
-      if (txn_id != INVALID_TXN_ID) {
-        txn_pages_[txn_id].insert(page_id);
+      frame.pin_count++;
+      if (first_fix) {
+        frame.lock_count++;
       }
-      
-      // Successfully acquired the lock
-      return *pool_[frame_id];
+      frame.referenced = true;
+      lock.unlock();
+
+      // Wait until the page is loaded, if another thread is still loading it
+      frame.latch.lock_shared();
+      frame.latch.unlock_shared();
+      return frame;
     }
-    
+
     // Page not in buffer, need to load it
-    if (free_frames_.empty()) {
-      throw buffer_full_error();
+    PageFrame victim;
+    size_t frame_id = get_free_frame(shard, victim);
+    if (victim.frame_id != INVALID_FRAME_ID) {
+      // Write back the victim without latching any shard, then look again
+      lock.unlock();
+      evict_dirty_frame(victim);
+      lock.lock();
+      continue;
     }
-    
-    frame_id = free_frames_.front();
-    free_frames_.pop_front();
-    
-    // Update page table
-    page_table_[page_id] = frame_id;
-    
-    // Set page ID in frame
-    pool_[frame_id]->page_id = page_id;
-    
-    // Track this page for the transaction
-    if (txn_id != INVALID_TXN_ID) {
-      txn_pages_[txn_id].insert(page_id);
+    if (frame_id != INVALID_FRAME_ID) {
+      shard.page_table[page_id] = frame_id;
+
+      auto& frame = *pool_[frame_id];
+      frame.page_id = page_id;
+      frame.dirty = false;
+      frame.pin_count = 1;
+      frame.lock_count = first_fix ? 1 : 0;
+      frame.referenced = true;
+
+      // Read data from disk without holding the shard latch. The frame is
+      // pinned, and its latch keeps others out until the page is loaded.
+      std::unique_lock<RWLatch> latch(frame.latch);
+      lock.unlock();
+      read_frame(frame_id, page_id);
+      return frame;
     }
-    
-    // Acquire lock for the new page
-    LockMode mode = exclusive ? LockMode::EXCLUSIVE : LockMode::SHARED;
-    if (!lock_manager_.acquire_lock(txn_id, page_id, mode)) {
-      // This shouldn't happen for a new page, but handle it anyway
-      throw transaction_abort_error();
+
+    // All frames are pinned or fixed by running transactions. Wait until a
+    // page is unfixed or a transaction ends instead of failing right away.
+    // Only frames of this shard notify it, so look at the other shards
+    // regularly.
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      fail();
     }
+    shard.frame_released.wait_until(
+        lock, std::min(deadline, now + std::chrono::milliseconds(WAKE_INTERVAL_MS)));
   }
-  
-  // Read data from disk
-  read_frame(frame_id);
-  
-  return *pool_[frame_id];
 }
 
 void BufferManager::unfix_page(uint64_t /* txn_id */, BufferFrame& page, bool is_dirty) {
+  // The page cannot change while it is pinned
+  Shard& shard = get_shard(page.page_id);
+  std::unique_lock<std::mutex> lock(shard.mutex);
+
   // Mark page as dirty if necessary
   if (is_dirty) {
     page.mark_dirty();
   }
-  
+
   // Note: We don't release locks here, as they are meant to be held until
   // transaction_complete or transaction_abort is called (two-phase locking)
+  unpin_frame(shard, lock, page.frame_id);
+}
+
+void BufferManager::unpin_frame(Shard& shard, std::unique_lock<std::mutex>& lock,
+                                size_t frame_id) {
+  auto& frame = *pool_[frame_id];
+  if (frame.pin_count > 0 && --frame.pin_count == 0) {
+    if (frame.discarded) {
+      free_frame(shard, lock, frame_id);
+    } else {
+      shard.frame_released.notify_all();
+    }
+  }
 }
 
 void BufferManager::flush_all_pages() {
-  for (size_t frame_id = 0; frame_id < capacity_; frame_id++) {
-    if (pool_[frame_id]->dirty == true) {
-      write_frame(frame_id);
-      pool_[frame_id]->dirty = false;
+  std::vector<PageFrame> frames;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (size_t frame_id : shard.frames) {
+      pin_dirty_frame(frame_id, frames);
     }
   }
+  write_pinned_frames(frames);
 }
 
 void BufferManager::flush_page(uint64_t page_id) {
-  std::lock_guard<std::mutex> lock(pool_mutex_);
-  
-  auto it = page_table_.find(page_id);
-  if (it != page_table_.end()) {
-    size_t frame_id = it->second;
-    if (pool_[frame_id]->dirty) {
-      write_frame(frame_id);
-      pool_[frame_id]->dirty = false;
+  std::vector<PageFrame> frames;
+  {
+    Shard& shard = get_shard(page_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.page_table.find(page_id);
+    if (it != shard.page_table.end()) {
+      pin_dirty_frame(it->second, frames);
     }
   }
+  write_pinned_frames(frames);
+}
+
+void BufferManager::pin_dirty_frame(size_t frame_id, std::vector<PageFrame>& frames) {
+  auto& frame = *pool_[frame_id];
+  // Discarded pages must not be written back, and evicting pages are
+  // written back by their eviction
+  if (!frame.dirty || frame.discarded || frame.evicting) {
+    return;
+  }
+  // The pin keeps the page in the frame until it is written. Changes that
+  // are unfixed meanwhile mark it dirty again.
+  frame.pin_count++;
+  frame.dirty = false;
+  frames.push_back({frame_id, frame.page_id});
+}
+
+void BufferManager::write_pinned_frames(const std::vector<PageFrame>& frames) {
+  // Write all pages first, so that every segment is synced only once
+  std::set<uint16_t> segment_ids;
+  for (auto& frame : frames) {
+    write_frame(frame.frame_id, frame.page_id);
+    segment_ids.insert(get_segment_id(frame.page_id));
+
+    Shard& shard = get_shard(frame.page_id);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    unpin_frame(shard, lock, frame.frame_id);
+  }
+  sync_segments(segment_ids);
+}
+
+void BufferManager::reset_frame(Shard& shard, std::unique_lock<std::mutex>& lock,
+                                size_t frame_id) {
+  auto& frame = *pool_[frame_id];
+
+  // An evicting page was not fixed by a running transaction when it was
+  // chosen, and cannot be fixed since, so it holds no changes. It leaves
+  // once it is written back.
+  if (frame.evicting) {
+    return;
+  }
+
+  // Remove from page table, so that the page is loaded again
+  shard.page_table.erase(frame.page_id);
+
+  // A thread still uses the page, e.g., of the transaction that discards it.
+  // Its bytes must stay until it unfixes the page.
+  if (frame.pin_count > 0) {
+    frame.discarded = true;
+    return;
+  }
+  free_frame(shard, lock, frame_id);
+}
+
+void BufferManager::free_frame(Shard& shard, std::unique_lock<std::mutex>& lock,
+                               size_t frame_id) {
+  auto& frame = *pool_[frame_id];
+
+  // Reset the frame. It is neither in the page table nor free, so no other
+  // thread uses it until it is added to the free frames.
+  frame.page_id = INVALID_PAGE_ID;
+  frame.dirty = false;
+  frame.pin_count = 0;
+  frame.lock_count = 0;
+  frame.referenced = false;
+  frame.discarded = false;
+  frame.evicting = false;
+
+  // Wait for a thread that still accesses the bytes without the shard
+  // latch, so that its I/O does not stall the shard
+  lock.unlock();
+  frame.latch.lock();
+  frame.latch.unlock();
+  lock.lock();
+
+  // Add to free frames
+  shard.free_frames.push_back(frame_id);
+  shard.frame_released.notify_all();
 }
 
 void BufferManager::discard_page(uint64_t page_id) {
-  std::lock_guard<std::mutex> lock(pool_mutex_);
-  
-  auto it = page_table_.find(page_id);
-  if (it != page_table_.end()) {
-    size_t frame_id = it->second;
-    
-    // Reset the frame
-    pool_[frame_id]->page_id = INVALID_PAGE_ID;
-    pool_[frame_id]->dirty = false;
-    
-    // Remove from page table
-    page_table_.erase(it);
-    
-    // Add to free frames
-    free_frames_.push_back(frame_id);
+  Shard& shard = get_shard(page_id);
+  std::unique_lock<std::mutex> lock(shard.mutex);
+
+  auto it = shard.page_table.find(page_id);
+  if (it != shard.page_table.end()) {
+    reset_frame(shard, lock, it->second);
   }
 }
 
 void BufferManager::discard_all_pages() {
-  std::lock_guard<std::mutex> lock(pool_mutex_);
-  
-  for (size_t frame_id = 0; frame_id < capacity_; frame_id++) {
-    pool_[frame_id].reset(new BufferFrame());
-    pool_[frame_id]->page_id = INVALID_PAGE_ID;
-    pool_[frame_id]->dirty = false;
-    pool_[frame_id]->data.resize(page_size_);
-    pool_[frame_id]->frame_id = frame_id;
-  }
-  
-  // Clear page table
-  page_table_.clear();
-  
-  // Reset free frames
-  free_frames_.clear();
-  for (size_t frame_id = 0; frame_id < capacity_; frame_id++) {
-    free_frames_.push_back(frame_id);
+  for (auto& shard : shards_) {
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    // Freeing a frame releases the latch, so every page is looked up again
+    std::vector<uint64_t> page_ids;
+    for (auto& entry : shard.page_table) {
+      page_ids.push_back(entry.first);
+    }
+    for (uint64_t page_id : page_ids) {
+      auto it = shard.page_table.find(page_id);
+      if (it != shard.page_table.end()) {
+        reset_frame(shard, lock, it->second);
+      }
+    }
   }
 }
 
 void BufferManager::flush_pages(uint64_t txn_id) {
-  std::lock_guard<std::mutex> lock(pool_mutex_);
-  
-  auto it = txn_pages_.find(txn_id);
-  if (it != txn_pages_.end()) {
-    for (uint64_t page_id : it->second) {
-      auto frame_it = page_table_.find(page_id);
-      if (frame_it != page_table_.end()) {
-        size_t frame_id = frame_it->second;
-        if (pool_[frame_id]->dirty) {
-          write_frame(frame_id);
-          pool_[frame_id]->dirty = false;
-        }
-      }
+  std::set<uint64_t> page_ids;
+  {
+    std::lock_guard<std::mutex> lock(txn_pages_mutex_);
+    auto it = txn_pages_.find(txn_id);
+    if (it != txn_pages_.end()) {
+      page_ids = it->second;
     }
   }
+
+  std::vector<PageFrame> frames;
+  for (uint64_t page_id : page_ids) {
+    Shard& shard = get_shard(page_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.page_table.find(page_id);
+    if (it != shard.page_table.end()) {
+      pin_dirty_frame(it->second, frames);
+    }
+  }
+  write_pinned_frames(frames);
 }
 
 void BufferManager::discard_pages(uint64_t txn_id) {
-  std::lock_guard<std::mutex> lock(pool_mutex_);
-  
-  auto it = txn_pages_.find(txn_id);
-  if (it != txn_pages_.end()) {
-    for (uint64_t page_id : it->second) {
-      auto frame_it = page_table_.find(page_id);
-      if (frame_it != page_table_.end()) {
-        size_t frame_id = frame_it->second;
-        
-        // Reset the frame
-        pool_[frame_id]->page_id = INVALID_PAGE_ID;
-        pool_[frame_id]->dirty = false;
-        
-        // Remove from page table
-        page_table_.erase(frame_it);
-        
-        // Add to free frames
-        free_frames_.push_back(frame_id);
-      }
+  std::set<uint64_t> page_ids;
+  {
+    std::lock_guard<std::mutex> lock(txn_pages_mutex_);
+    auto it = txn_pages_.find(txn_id);
+    if (it != txn_pages_.end()) {
+      page_ids = it->second;
+    }
+  }
+
+  // Only pages the transaction locked exclusively can hold its changes.
+  // Pages it locked shared may be in use by other transactions.
+  for (uint64_t page_id : page_ids) {
+    if (lock_manager_.get_frame_lock_manager(page_id).has_exclusive_lock(txn_id)) {
+      discard_page(page_id);
+
+      // The page left the buffer, the transaction no longer keeps it there
+      std::lock_guard<std::mutex> lock(txn_pages_mutex_);
+      txn_pages_[txn_id].erase(page_id);
+    }
+  }
+}
+
+void BufferManager::release_pages(uint64_t txn_id) {
+  std::set<uint64_t> page_ids;
+  {
+    std::lock_guard<std::mutex> lock(txn_pages_mutex_);
+    auto it = txn_pages_.find(txn_id);
+    if (it != txn_pages_.end()) {
+      page_ids = std::move(it->second);
+      txn_pages_.erase(it);
+    }
+  }
+
+  for (uint64_t page_id : page_ids) {
+    Shard& shard = get_shard(page_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.page_table.find(page_id);
+    if (it == shard.page_table.end()) {
+      continue;
+    }
+    auto& frame = *pool_[it->second];
+    if (frame.lock_count > 0 && --frame.lock_count == 0) {
+      shard.frame_released.notify_all();
     }
-    
-    // Clear transaction pages
-    txn_pages_.erase(it);
   }
 }
 
 void BufferManager::transaction_complete(uint64_t txn_id) {
-  // First, flush all dirty pages for this transaction
+  // First, flush all dirty pages for this transaction. They are durable
+  // before other transactions can lock them.
   flush_pages(txn_id);
-  
+
+  // The pages can be evicted again. This happens while they are still
+  // locked, so that only transactions that fixed a page count for it.
+  release_pages(txn_id);
+
   // Release all locks held by this transaction
   lock_manager_.release_all_locks(txn_id);
-  
-  // Clean up transaction pages tracking with proper locking
-  {
-    std::lock_guard<std::mutex> lock(pool_mutex_);
-    txn_pages_.erase(txn_id);
-  }
 }
 
 void BufferManager::transaction_abort(uint64_t txn_id) {
+  // Discard all pages modified by this transaction. This happens before the
+  // locks are released, so that eviction cannot write the changes back.
+  discard_pages(txn_id);
+  release_pages(txn_id);
+
   // Release all locks held by this transaction
   lock_manager_.release_all_locks(txn_id);
-  
-  // Discard all pages modified by this transaction
-  discard_pages(txn_id);
-  
-  // Clean up transaction pages tracking
-  std::lock_guard<std::mutex> lock(pool_mutex_);
-  txn_pages_.erase(txn_id);
 }
 
-void BufferManager::read_frame(uint64_t frame_id) {
-  std::lock_guard<std::mutex> file_guard(file_use_mutex_);
+File& BufferManager::get_segment_file(uint16_t segment_id) {
+  {
+    std::shared_lock<std::shared_mutex> lock(segment_files_mutex_);
+    auto it = segment_files_.find(segment_id);
+    if (it != segment_files_.end()) {
+      return *it->second;
+    }
+  }
 
-  auto segment_id = get_segment_id(pool_[frame_id]->page_id);
-  auto file_handle = File::open_file(std::to_string(segment_id).c_str(), File::WRITE);
-  if (file_handle) {
-    size_t start = get_segment_page_id(pool_[frame_id]->page_id) * page_size_;
-    file_handle->read_block(start, page_size_, pool_[frame_id]->data.data());
+  std::unique_lock<std::shared_mutex> lock(segment_files_mutex_);
+  auto& file = segment_files_[segment_id];
+  if (!file) {
+    file = File::open_file(std::to_string(segment_id).c_str(), File::WRITE);
   }
+  return *file;
 }
 
-void BufferManager::write_frame(uint64_t frame_id) {
-  std::lock_guard<std::mutex> file_guard(file_use_mutex_);
+void BufferManager::read_frame(size_t frame_id, uint64_t page_id) {
+  // Pages past the end of the segment are not read at all and must not
+  // keep the content of an evicted page.
+  auto& data = pool_[frame_id]->data;
+  std::fill(data.begin(), data.end(), 0);
+  size_t start = get_segment_page_id(page_id) * page_size_;
+  get_segment_file(get_segment_id(page_id)).read_block(start, page_size_, data.data());
+}
+
+void BufferManager::write_frame(size_t frame_id, uint64_t page_id) {
+  // Write a consistent image of the page, while readers may go on
+  std::shared_lock<RWLatch> latch(pool_[frame_id]->latch);
+
+  size_t start = get_segment_page_id(page_id) * page_size_;
+  get_segment_file(get_segment_id(page_id))
+      .write_block(pool_[frame_id]->data.data(), start, page_size_);
+}
 
-  auto segment_id = get_segment_id(pool_[frame_id]->page_id);
-  auto file_handle = File::open_file(std::to_string(segment_id).c_str(), File::WRITE);
-  if (file_handle) {
-    size_t start = get_segment_page_id(pool_[frame_id]->page_id) * page_size_;
-    file_handle->write_block(pool_[frame_id]->data.data(), start, page_size_);
+void BufferManager::sync_segments(const std::set<uint16_t>& segment_ids) {
+  for (uint16_t segment_id : segment_ids) {
+    get_segment_file(segment_id).sync();
   }
 }
 
@@ -1,11 +1,31 @@
 
 #include <iostream>
+#include <mutex>
+#include <shared_mutex>
 
 #include "heap/heap_file.h"
 #include "common/macros.h"
 
 namespace buzzdb {
 
+namespace {
+
+/// Points the header of a slotted page at the frame that holds it. The page
+/// may have been evicted and loaded into another frame since it was used.
+void refresh_buffer_frame(BufferFrame &frame) {
+  auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
+  {
+    std::shared_lock<RWLatch> latch(frame.get_latch());
+    if (page->header.buffer_frame == frame.get_data()) {
+      return;
+    }
+  }
+  std::unique_lock<RWLatch> latch(frame.get_latch());
+  page->header.buffer_frame = frame.get_data();
+}
+
+}  // namespace
+
 HeapPage::Header::Header(char *_buffer_frame, uint32_t page_size) {
   buffer_frame = _buffer_frame;
   last_dirtied_transaction_id = INVALID_TXN_ID;
@@ -161,14 +181,21 @@ TID HeapSegment::allocate(uint32_t record_size, uint64_t txn_id) {
 				BufferManager::get_overall_page_id(segment_id_, segment_page_itr);
 
 		BufferFrame &frame = buffer_manager_.fix_page(txn_id, page_id, true);
+		std::unique_lock<RWLatch> latch(frame.get_latch());
 
 		auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
+		// The page may have been evicted and loaded into another frame.
+		page->header.buffer_frame = frame.get_data();
 
 		if(record_size > page->header.free_space){
+			latch.unlock();
+			buffer_manager_.unfix_page(txn_id, frame, false);
 			continue;
 		}
 
 		TID tid = page->addSlot(record_size);
+		latch.unlock();
+		buffer_manager_.unfix_page(txn_id, frame, true);
 		return tid;
 	}
 
@@ -182,6 +209,7 @@ TID HeapSegment::allocate(uint32_t record_size, uint64_t txn_id) {
 	page_count_++;
 
 	BufferFrame& frame = buffer_manager_.fix_page(txn_id, page_id, true);
+	std::unique_lock<RWLatch> latch(frame.get_latch());
 
 	auto* page = new (frame.get_data())
 			SlottedPage(frame.get_data(), buffer_manager_.get_page_size());
@@ -189,6 +217,8 @@ TID HeapSegment::allocate(uint32_t record_size, uint64_t txn_id) {
 	page->header.overall_page_id = page_id;
 
 	TID tid = page->addSlot(record_size);
+	latch.unlock();
+	buffer_manager_.unfix_page(txn_id, frame, true);
 
 	return tid;
 }
@@ -201,6 +231,8 @@ uint32_t HeapSegment::read(TID tid, std::byte* record, uint32_t capacity, uint64
   std::cout << "DEBUG::READ" << std::endl;
 
   BufferFrame& frame = buffer_manager_.fix_page(txn_id, overall_page_id, false);
+  refresh_buffer_frame(frame);
+  std::shared_lock<RWLatch> latch(frame.get_latch());
   auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
 
   std::cout << *page;
@@ -219,6 +251,9 @@ uint32_t HeapSegment::read(TID tid, std::byte* record, uint32_t capacity, uint64
     exit(0);
   }
 
+  latch.unlock();
+  buffer_manager_.unfix_page(txn_id, frame, false);
+
   return length;
 }
 
@@ -230,7 +265,9 @@ uint32_t HeapSegment::write(TID tid, std::byte* record, uint32_t record_size, UN
   uint16_t slot_id = tid.value & ((1ull << 16) - 1);
 
   BufferFrame& frame = buffer_manager_.fix_page(txn_id, overall_page_id, true);
+  std::unique_lock<RWLatch> latch(frame.get_latch());
   auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
+  page->header.buffer_frame = frame.get_data();
 
   buzzdb::SlottedPage::Slot slot = page->getSlot(slot_id);
   uint64_t value = slot.value;
@@ -239,7 +276,8 @@ uint32_t HeapSegment::write(TID tid, std::byte* record, uint32_t record_size, UN
   
   // update
   memcpy(&frame.get_data()[offset], record, record_size);
-  frame.mark_dirty();
+  latch.unlock();
+  buffer_manager_.unfix_page(txn_id, frame, true);
   return 0;
 }
 
@@ -254,10 +292,13 @@ std::ostream &operator<<(std::ostream &os, HeapSegment const &s) {
 						segment_page_itr);
 
 		BufferFrame &frame = s.buffer_manager_.fix_page(INVALID_TXN_ID, page_id, true);
+		refresh_buffer_frame(frame);
 
-		auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
-
-		os << *page;
+		{
+			std::shared_lock<RWLatch> latch(frame.get_latch());
+			auto* page = reinterpret_cast<SlottedPage*>(frame.get_data());
+			os << *page;
+		}
 
 		s.buffer_manager_.unfix_page(INVALID_TXN_ID, frame, false);
 	}
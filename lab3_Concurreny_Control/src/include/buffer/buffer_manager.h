@@ -16,6 +16,8 @@
 #include <condition_variable>
 
 #include "common/macros.h"
+#include "common/rw_latch.h"
+#include "storage/file.h"
 
 namespace buzzdb {
 
@@ -80,8 +82,32 @@ class BufferFrame {
 	std::vector<char> data;
 
 	bool dirty;
-	bool exclusive;
-	std::thread::id exclusive_thread_id;
+
+	/// Guards the bytes of the page while they are read or written. Unlike
+	/// the locks of the `LockManager`, which isolate transactions until they
+	/// end, it is only held for single accesses and while the page is loaded
+	/// or written back.
+	RWLatch latch;
+
+	/// Number of `fix_page()` calls that were not unfixed yet. Pinned frames
+	/// are never evicted.
+	size_t pin_count;
+
+	/// Number of running transactions that fixed the page. They may have
+	/// changed it, so it is not evicted before they end.
+	size_t lock_count;
+
+	/// Set whenever the page is fixed, cleared by the CLOCK hand.
+	bool referenced;
+
+	/// Set when the page was discarded while it was pinned. The frame is no
+	/// longer in the page table, and the last `unfix_page()` frees it.
+	bool discarded;
+
+	/// Set while the dirty page is written back to be evicted. It stays in
+	/// the page table, but is not pinned until it is evicted and loaded
+	/// again.
+	bool evicting;
 
  public:
 	/// Returns a pointer to this page's data.
@@ -89,11 +115,17 @@ class BufferFrame {
 
 	BufferFrame();
 
+	/// Copies the page, but not the bookkeeping of the buffer manager, which
+	/// other threads may change meanwhile.
 	BufferFrame(const BufferFrame &other);
 
 	BufferFrame &operator=(BufferFrame other);
 
 	void mark_dirty() {dirty = true;}
+
+	/// Returns the latch of the page's bytes. Take it shared to read the
+	/// page and exclusively to modify it.
+	RWLatch &get_latch() { return latch; }
 };
 
 class buffer_full_error : public std::exception {
@@ -117,8 +149,17 @@ class BufferManager {
 	/// Destructor. Writes all dirty pages to disk.
 	~BufferManager();
 
+	/// Locks the page for the transaction and pins it. The page is loaded
+	/// when this returns, but its bytes must be accessed under its latch,
+	/// see `BufferFrame::get_latch()`.
+	/// When the page is not in the buffer and no frame is free, an unpinned
+	/// frame whose page no running transaction fixed is evicted with CLOCK,
+	/// and written back first if it is dirty. When there is none, waits for one and throws
+	/// `buffer_full_error` after a timeout.
 	BufferFrame &fix_page(uint64_t txn_id, uint64_t page_id, bool exclusive);
 
+	/// Unpins a page that was returned by `fix_page()`. The lock stays until
+	/// the transaction completes or aborts.
 	void unfix_page(uint64_t txn_id, BufferFrame& page, bool is_dirty);
 
 	/// Returns the segment id for a given page id which is contained in the 16
@@ -153,6 +194,8 @@ class BufferManager {
 
 	size_t get_page_size() { return page_size_; }
 
+	/// Write dirty pages back to their segments. They are durable when these
+	/// return.
 	void flush_all_pages();
 	void flush_page(uint64_t page_id);
 	void discard_page(uint64_t page_id);
@@ -163,21 +206,99 @@ class BufferManager {
 	void transaction_abort(uint64_t txn_id);
 
  private:
+	/// Maximum number of shards of the page table.
+	static constexpr size_t NUM_SHARDS = 16;
+
+	/// Milliseconds after which a fix that waits for a frame looks at the
+	/// other shards again. Only frames of its own shard notify it.
+	static constexpr uint64_t WAKE_INTERVAL_MS = 100;
+
+	/// A partition of the buffer pool. Every page belongs to the shard given
+	/// by a hash of its id, and is only loaded into frames of that shard. The
+	/// latch of a shard protects its page table, its frames and their
+	/// `page_id`, `dirty`, `pin_count`, `lock_count`, `referenced`,
+	/// `discarded` and `evicting`.
+	struct Shard {
+		std::mutex mutex;
+		/// Notified when a frame of the shard may have become evictable.
+		std::condition_variable frame_released;
+		std::unordered_map<uint64_t, size_t> page_table;
+		/// All frames of the shard, with or without a page.
+		std::vector<size_t> frames;
+		/// Frames of the shard that hold no page.
+		std::deque<size_t> free_frames;
+		/// Index of the next frame in `frames` the CLOCK hand looks at.
+		size_t clock_hand = 0;
+	};
+
+	/// A frame and the page it held while its shard was latched, e.g., a
+	/// dirty page that is written back after the latch is released.
+	struct PageFrame {
+		size_t frame_id = INVALID_FRAME_ID;
+		uint64_t page_id = INVALID_PAGE_ID;
+	};
+
 	uint64_t capacity_;
 	size_t page_size_;
 	std::vector<std::unique_ptr<BufferFrame>> pool_;
 
-	mutable std::mutex file_use_mutex_;
-	mutable std::mutex pool_mutex_;
-	std::deque<size_t> free_frames_;
-	std::unordered_map<uint64_t, size_t> page_table_;
+	std::vector<Shard> shards_;
+	/// The files of the segments, opened on first use and shared by all
+	/// reads and writes. The latch is only held to look them up.
+	std::shared_mutex segment_files_mutex_;
+	std::unordered_map<uint16_t, std::unique_ptr<File>> segment_files_;
+	std::mutex txn_pages_mutex_;
 	std::unordered_map<uint64_t, std::set<uint64_t>> txn_pages_;
 	LockManager lock_manager_;
 
-	size_t get_frame_id(uint64_t page_id);
-	size_t get_free_frame();
-	void read_frame(uint64_t frame_id);
-	void write_frame(uint64_t frame_id);
+	/// Returns the shard of a page.
+	Shard& get_shard(uint64_t page_id);
+	/// Returns a free frame for a page of `shard`, whose latch must be held.
+	/// Takes a free frame of the shard or, without waiting, of another
+	/// shard, or evicts a page. Returns `INVALID_FRAME_ID` when all frames
+	/// are pinned or fixed by running transactions, or their shards are
+	/// busy, or when the victim is dirty. Then `victim` is set to it, and
+	/// must be passed to `evict_dirty_frame()`.
+	size_t get_free_frame(Shard& shard, PageFrame& victim);
+	/// Removes a free frame from `from` and returns it, or returns
+	/// `INVALID_FRAME_ID` when there is none.
+	size_t take_free_frame(Shard& from);
+	/// Evicts an unpinned page that no running transaction fixed from `from`
+	/// with CLOCK and returns its frame, or returns `INVALID_FRAME_ID`. A
+	/// dirty victim is only marked as `evicting` and returned in `victim`.
+	size_t evict_frame(Shard& from, PageFrame& victim);
+	/// Writes back a victim of `evict_frame()` and frees its frame. Must be
+	/// called without holding a shard latch.
+	void evict_dirty_frame(const PageFrame& victim);
+	/// Moves a frame without a page from `from` to `to`.
+	void move_frame(size_t frame_id, Shard& from, Shard& to);
+	/// Removes the page of a resident frame from its shard without writing
+	/// it back. A pinned frame is only freed by its last unpin. `lock` holds
+	/// the latch of `shard`, and is released meanwhile.
+	void reset_frame(Shard& shard, std::unique_lock<std::mutex>& lock, size_t frame_id);
+	/// Resets a frame that is not pinned and adds it to the free frames once
+	/// no thread accesses its bytes anymore. `lock` holds the latch of
+	/// `shard`, and is released while it waits.
+	void free_frame(Shard& shard, std::unique_lock<std::mutex>& lock, size_t frame_id);
+	/// Unpins a frame of `shard`, whose latch `lock` holds. The last unpin of
+	/// a discarded frame frees it.
+	void unpin_frame(Shard& shard, std::unique_lock<std::mutex>& lock, size_t frame_id);
+	/// Forgets the pages of a transaction that ends, so that they can be
+	/// evicted again.
+	void release_pages(uint64_t txn_id);
+	/// Returns the file of a segment.
+	File& get_segment_file(uint16_t segment_id);
+	void read_frame(size_t frame_id, uint64_t page_id);
+	void write_frame(size_t frame_id, uint64_t page_id);
+	/// Pins a resident frame if it is dirty and marks it clean, so that its
+	/// page can be written back without the latch of its shard, which must
+	/// be held. Adds it to `frames`.
+	void pin_dirty_frame(size_t frame_id, std::vector<PageFrame>& frames);
+	/// Writes back and unpins the frames of `pin_dirty_frame()`, and makes
+	/// the writes durable. Must be called without holding a shard latch.
+	void write_pinned_frames(const std::vector<PageFrame>& frames);
+	/// Makes the writes to the segments durable.
+	void sync_segments(const std::set<uint16_t>& segment_ids);
 };
 
 }  // namespace buzzdb
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+namespace buzzdb {
+
+/// A reader/writer spin latch in a single word, for short critical sections
+/// such as copying the bytes of a page. Unlike `std::shared_mutex`, it takes
+/// 4 bytes and never enters the kernel when it is free. A waiting writer
+/// keeps new readers out, so that writers do not starve.
+/// Can be used with `std::unique_lock` and `std::shared_lock`.
+class RWLatch {
+ public:
+  RWLatch() = default;
+
+  RWLatch(const RWLatch&) = delete;
+  RWLatch& operator=(const RWLatch&) = delete;
+
+  /// Latches exclusively.
+  void lock() {
+    for (size_t spins = 0;; backoff(spins)) {
+      uint32_t state = state_.load(std::memory_order_relaxed);
+      if ((state & ~WAITING) == 0) {
+        if (state_.compare_exchange_weak(state, WRITER, std::memory_order_acquire)) {
+          return;
+        }
+      } else if ((state & WAITING) == 0) {
+        state_.compare_exchange_weak(state, state | WAITING, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Latches exclusively if nobody holds the latch.
+  bool try_lock() {
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    return (state & ~WAITING) == 0 &&
+           state_.compare_exchange_strong(state, WRITER, std::memory_order_acquire);
+  }
+
+  void unlock() { state_.fetch_and(~WRITER, std::memory_order_release); }
+
+  /// Latches shared, once no writer holds or waits for the latch.
+  void lock_shared() {
+    for (size_t spins = 0; !try_lock_shared(); backoff(spins)) {
+    }
+  }
+
+  bool try_lock_shared() {
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    return (state & (WRITER | WAITING)) == 0 &&
+           state_.compare_exchange_weak(state, state + 1, std::memory_order_acquire);
+  }
+
+  void unlock_shared() { state_.fetch_sub(1, std::memory_order_release); }
+
+ private:
+  /// Set while a writer holds the latch.
+  static constexpr uint32_t WRITER = 1u << 31;
+  /// Set while a writer waits for the latch. The other bits count the
+  /// readers.
+  static constexpr uint32_t WAITING = 1u << 30;
+
+  /// Spins for a while, then lets other threads run.
+  static void backoff(size_t& spins) {
+    if (++spins > 64) {
+      std::this_thread::yield();
+    }
+  }
+
+  std::atomic<uint32_t> state_{0};
+};
+
+}  // namespace buzzdb
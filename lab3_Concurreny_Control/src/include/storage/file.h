@@ -1,7 +1,10 @@
 #pragma once
 
 #include <cstdint>
+#include <cstdlib>
 #include <memory>
+#include <new>
+#include <vector>
 
 namespace buzzdb {
 
@@ -13,6 +16,62 @@ class File {
   /// File mode (read or write)
   enum Mode { READ, WRITE };
 
+  /// How reads and writes reach the device.
+  enum IOMode {
+    /// Reads and writes go through the page cache of the operating system.
+    /// Writes are durable only after `sync()`.
+    BUFFERED,
+    /// Like `BUFFERED`, but every `write_block()` is durable when it
+    /// returns.
+    SYNC,
+    /// Requests whose offset, size and memory address are multiples of
+    /// `DIRECT_IO_ALIGNMENT` bypass the page cache, all other requests go
+    /// through it. Writes are durable only after `sync()`.
+    DIRECT,
+  };
+
+  /// Expected access pattern of a range of the file, see `advise()`.
+  enum Advice {
+    /// No particular access pattern.
+    NORMAL,
+    /// The range is read sequentially, so it can be read ahead aggressively
+    /// and evicted from memory soon after it was read.
+    SEQUENTIAL,
+    /// The range is read soon, so it can be read ahead right away.
+    WILLNEED,
+  };
+
+  /// A block of a `read_blocks()` request.
+  struct ReadRequest {
+    /// The offset in the file from which the block should be read.
+    size_t offset;
+    /// The size of the block.
+    size_t size;
+    /// Memory where the block is written to.
+    char* block;
+  };
+
+  /// A block of a `write_blocks()` request.
+  struct WriteRequest {
+    /// Memory that will be written to the file.
+    const char* block;
+    /// The offset in the file at which the block should be written.
+    size_t offset;
+    /// The size of the block.
+    size_t size;
+  };
+
+  /// Alignment of offsets, sizes and memory addresses of `DIRECT` requests.
+  static constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+
+  /// Frees memory from `allocate_aligned_block()`.
+  struct AlignedBlockDeleter {
+    void operator()(char* block) const { std::free(block); }
+  };
+
+  /// Memory that is aligned to `DIRECT_IO_ALIGNMENT`.
+  using AlignedBlock = std::unique_ptr<char[], AlignedBlockDeleter>;
+
   virtual ~File() = default;
 
   /// Returns the `Mode` this file was opened with.
@@ -46,6 +105,33 @@ class File {
     return block;
   }
 
+  /// Reads several blocks of the file, like one `read_block()` per request.
+  /// Files may serve requests for adjacent blocks with a single system call,
+  /// so callers should order them by offset.
+  /// Is thread-safe w.r.t concurrent calls to `read_block()` and
+  /// `write_block()`.
+  virtual void read_blocks(const std::vector<ReadRequest>& requests) {
+    for (auto& request : requests) {
+      read_block(request.offset, request.size, request.block);
+    }
+  }
+
+  /// Returns a pointer to a block of the file without copying it, or
+  /// `nullptr` if the file cannot provide one. Callers then fall back to
+  /// `read_block()`. `offset + size` must not be larger than `size()`. The
+  /// pointer stays valid until the next `resize()` and reflects later
+  /// writes to the block.
+  /// Is thread-safe w.r.t concurrent calls to `read_block()` and
+  /// `write_block()`.
+  virtual const char* view_block(size_t /*offset*/, size_t /*size*/) {
+    return nullptr;
+  }
+
+  /// Tells the file how a block of it will be accessed, so that it can read
+  /// ahead or evict memory early. This is only a hint, files may ignore it.
+  /// Is thread-safe.
+  virtual void advise(Advice /*advice*/, size_t /*offset*/, size_t /*size*/) {}
+
   /// Writes a block to the file. `offset + size` must not be larger than
   /// `size()`. If you want to write past the end of the file, use
   /// `resize()` first.
@@ -59,14 +145,51 @@ class File {
   /// @param[in] size   The size of the block.
   virtual void write_block(const char* block, size_t offset, size_t size) = 0;
 
+  /// Writes several blocks to the file, like one `write_block()` per
+  /// request in the given order. Files may serve requests for adjacent
+  /// blocks with a single system call, so callers should order them by
+  /// offset.
+  /// Is thread-safe w.r.t concurrent calls to `read_block()` and
+  /// `write_block()`.
+  virtual void write_blocks(const std::vector<WriteRequest>& requests) {
+    for (auto& request : requests) {
+      write_block(request.block, request.offset, request.size);
+    }
+  }
+
+  /// Makes all writes that returned so far durable, including the file
+  /// size after `resize()`.
+  /// Is thread-safe w.r.t concurrent calls to `read_block()` and
+  /// `write_block()`.
+  virtual void sync() = 0;
+
+  /// Allocates a block of `size` bytes for `DIRECT` requests. `size` is
+  /// rounded up to a multiple of `DIRECT_IO_ALIGNMENT`.
+  static AlignedBlock allocate_aligned_block(size_t size) {
+    size = (size + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    auto* block = static_cast<char*>(std::aligned_alloc(DIRECT_IO_ALIGNMENT, size));
+    if (block == nullptr) {
+      throw std::bad_alloc();
+    }
+    return AlignedBlock(block);
+  }
+
   /// Opens a file with the given mode. Existing files are never overwritten.
   /// @param[in] filename Path to the file.
   /// @param[in] mode     `Mode` that should be used to open the file.
-  static std::unique_ptr<File> open_file(const char* filename, Mode mode);
+  /// @param[in] io_mode  `IOMode` that should be used for reads and writes.
+  ///                     Callers that need durability either call `sync()`
+  ///                     or open the file in `SYNC` mode.
+  static std::unique_ptr<File> open_file(const char* filename, Mode mode,
+                                         IOMode io_mode = BUFFERED);
 
   /// Opens a temporary file in `WRITE` mode. The file will be deleted
   /// automatically after use.
-  static std::unique_ptr<File> make_temporary_file();
+  /// @param[in] io_mode   `IOMode` that should be used for reads and writes.
+  /// @param[in] directory Directory in which the file is created, or
+  ///                      `nullptr` for the current directory.
+  static std::unique_ptr<File> make_temporary_file(IOMode io_mode = BUFFERED,
+                                                   const char* directory = nullptr);
 };
 
 }  // namespace buzzdb
@@ -1,15 +1,12 @@
+#include "storage/test_file.h"
 
-#include <fcntl.h>
-#include <stdlib.h>  // NOLINT
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <unistd.h>
-#include <cerrno>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <exception>
 #include <memory>
-#include <system_error>
-
-#include "storage/test_file.h"
+#include <thread>
+#include <utility>
 
 namespace buzzdb {
 
@@ -25,32 +22,131 @@ class TestFileError : public std::exception {
   const char* what() const noexcept override { return message; }
 };
 
+TestFile::TestFile(Mode mode) : mode(mode) {}
+
+TestFile::TestFile(std::vector<char>&& file_content, Mode mode) : mode(WRITE) {
+  resize(file_content.size());
+  write_block(file_content.data(), 0, file_content.size());
+  this->mode = mode;
+}
+
+TestFile::TestFile(const TestFile& other)
+    : mode(other.mode), file_size(other.file_size), device_model(other.device_model) {
+  for (auto& chunk : other.chunks) {
+    chunks.push_back({std::make_unique<char[]>(chunk.capacity), chunk.capacity});
+    std::memcpy(chunks.back().data.get(), chunk.data.get(), chunk.capacity);
+  }
+}
+
+TestFile& TestFile::operator=(const TestFile& other) {
+  if (this != &other) {
+    *this = TestFile(other);
+  }
+  return *this;
+}
+
+std::vector<char> TestFile::get_content() const {
+  std::vector<char> content(file_size);
+  for (size_t i = 0; i < chunks.size(); i++) {
+    size_t offset = i * CHUNK_SIZE;
+    std::memcpy(content.data() + offset, chunks[i].data.get(),
+                std::min(CHUNK_SIZE, file_size - offset));
+  }
+  return content;
+}
+
 File::Mode TestFile::get_mode() const { return mode; }
 
-size_t TestFile::size() const { return file_content.size(); }
+size_t TestFile::size() const { return file_size; }
 
 void TestFile::resize(size_t new_size) {
   if (mode == READ) {
     throw TestFileError{"trying to resize a read only file"};
   }
-  file_content.resize(new_size);
+  size_t num_chunks = (new_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  if (new_size < file_size) {
+    // The cut off bytes must be zero when the file grows again.
+    chunks.resize(num_chunks);
+    if (num_chunks > 0) {
+      Chunk& last = chunks.back();
+      size_t end = new_size - (num_chunks - 1) * CHUNK_SIZE;
+      std::memset(last.data.get() + end, 0, last.capacity - end);
+    }
+  } else {
+    // Only the last chunk may be too small. It grows geometrically, so that
+    // appending in small steps does not copy it every time.
+    size_t first = chunks.empty() ? 0 : chunks.size() - 1;
+    chunks.resize(num_chunks);
+    for (size_t i = first; i < num_chunks; i++) {
+      Chunk& chunk = chunks[i];
+      size_t needed = std::min(CHUNK_SIZE, new_size - i * CHUNK_SIZE);
+      if (chunk.capacity >= needed) {
+        continue;
+      }
+      size_t capacity = i + 1 < num_chunks
+                            ? CHUNK_SIZE
+                            : std::min(CHUNK_SIZE, std::max(needed, 2 * chunk.capacity));
+      auto data = std::make_unique<char[]>(capacity);
+      if (chunk.capacity > 0) {
+        std::memcpy(data.get(), chunk.data.get(), chunk.capacity);
+      }
+      chunk = {std::move(data), capacity};
+    }
+  }
+  file_size = new_size;
+}
+
+void TestFile::start_request(size_t offset, size_t size, const char* error) const {
+  if (offset + size > file_size) {
+    throw TestFileError{error};
+  }
+  auto delay = device_model.latency;
+  if (device_model.bandwidth > 0) {
+    delay += std::chrono::nanoseconds(size * 1000000000ull / device_model.bandwidth);
+  }
+  if (delay.count() > 0) {
+    std::this_thread::sleep_for(delay);
+  }
 }
 
 void TestFile::read_block(size_t offset, size_t size, char* block) {
-  if (offset + size > file_content.size()) {
-    throw TestFileError{"trying to read past end of file"};
+  start_request(offset, size, "trying to read past end of file");
+  while (size > 0) {
+    const Chunk& chunk = chunks[offset / CHUNK_SIZE];
+    size_t chunk_offset = offset % CHUNK_SIZE;
+    size_t bytes = std::min(size, CHUNK_SIZE - chunk_offset);
+    std::memcpy(block, chunk.data.get() + chunk_offset, bytes);
+    block += bytes;
+    offset += bytes;
+    size -= bytes;
+  }
+}
+
+const char* TestFile::view_block(size_t offset, size_t size) {
+  if (size == 0 || offset + size > file_size ||
+      offset / CHUNK_SIZE != (offset + size - 1) / CHUNK_SIZE) {
+    return nullptr;
   }
-  std::memcpy(block, file_content.data() + offset, size);
+  start_request(offset, size, "trying to view past end of file");
+  return chunks[offset / CHUNK_SIZE].data.get() + offset % CHUNK_SIZE;
 }
 
 void TestFile::write_block(const char* block, size_t offset, size_t size) {
   if (mode == READ) {
     throw TestFileError{"trying to write to a read only file"};
   }
-  if (offset + size > file_content.size()) {
-    throw TestFileError{"trying to write past end of file"};
+  start_request(offset, size, "trying to write past end of file");
+  while (size > 0) {
+    Chunk& chunk = chunks[offset / CHUNK_SIZE];
+    size_t chunk_offset = offset % CHUNK_SIZE;
+    size_t bytes = std::min(size, CHUNK_SIZE - chunk_offset);
+    std::memcpy(chunk.data.get() + chunk_offset, block, bytes);
+    block += bytes;
+    offset += bytes;
+    size -= bytes;
   }
-  std::memcpy(file_content.data() + offset, block, size);
 }
 
+void TestFile::sync() {}
+
 }  // namespace buzzdb
@@ -311,6 +311,272 @@ TEST(BufferManagerTransactionTest, CommitTransaction){
 }
 
 
+/**
+   * Pages of completed transactions are evicted when the buffer is full
+   */
+TEST(BufferManagerTransactionTest, EvictUnlockedPages){
+  BufferManager buffer_manager(128, 4);
+  buffer_manager.discard_all_pages();
+  for (uint64_t txn_id = 1; txn_id <= 20; txn_id++) {
+    uint64_t page_id = BufferManager::get_overall_page_id(125, txn_id);
+    auto& page = buffer_manager.fix_page(txn_id, page_id, true);
+    memset(page.get_data(), static_cast<int>(txn_id), 128);
+    buffer_manager.unfix_page(txn_id, page, true);
+    buffer_manager.transaction_complete(txn_id);
+  }
+
+  for (uint64_t txn_id = 1; txn_id <= 20; txn_id++) {
+    uint64_t page_id = BufferManager::get_overall_page_id(125, txn_id);
+    auto& page = buffer_manager.fix_page(100 + txn_id, page_id, false);
+    EXPECT_EQ(static_cast<char>(txn_id), page.get_data()[127]);
+    buffer_manager.unfix_page(100 + txn_id, page, false);
+    buffer_manager.transaction_complete(100 + txn_id);
+  }
+}
+
+/**
+   * Pages locked by a running transaction stay in the buffer, a full buffer
+   * waits for them
+   */
+TEST(BufferManagerTransactionTest, WaitForLockedPages){
+  BufferManager buffer_manager(128, 2);
+  auto& page_1 = buffer_manager.fix_page(1, 1, true);
+  buffer_manager.unfix_page(1, page_1, true);
+  auto& page_2 = buffer_manager.fix_page(1, 2, false);
+  buffer_manager.unfix_page(1, page_2, false);
+
+  auto fix = std::async(std::launch::async, [&buffer_manager]() {
+    auto& page = buffer_manager.fix_page(2, 3, false);
+    buffer_manager.unfix_page(2, page, false);
+  });
+  EXPECT_EQ(std::future_status::timeout,
+            fix.wait_for(std::chrono::milliseconds(500)));
+
+  buffer_manager.transaction_complete(1);
+  EXPECT_NO_THROW(fix.get());
+  buffer_manager.transaction_complete(2);
+
+  // Pinned pages are not evicted either
+  auto& page_4 = buffer_manager.fix_page(buzzdb::INVALID_TXN_ID, 4, false);
+  auto& page_5 = buffer_manager.fix_page(buzzdb::INVALID_TXN_ID, 5, false);
+  EXPECT_THROW(buffer_manager.fix_page(3, 6, false), buzzdb::buffer_full_error);
+  buffer_manager.unfix_page(buzzdb::INVALID_TXN_ID, page_4, false);
+  buffer_manager.unfix_page(buzzdb::INVALID_TXN_ID, page_5, false);
+}
+
+
+/**
+   * A transaction waiting for a lock does not stall fixes of other pages
+   */
+TEST(BufferManagerTransactionTest, LockWaitDoesNotBlockPool){
+  BufferManager buffer_manager(128, 10);
+  auto& page_1 = buffer_manager.fix_page(1, 1, true);
+  buffer_manager.unfix_page(1, page_1, true);
+
+  auto lock = LockGrabber(buffer_manager, 2, 1, true);
+  usleep(100000);
+  EXPECT_FALSE(lock.is_acquired());
+
+  auto start = std::chrono::steady_clock::now();
+  auto& page_2 = buffer_manager.fix_page(3, 2, true);
+  buffer_manager.unfix_page(3, page_2, true);
+  buffer_manager.transaction_complete(3);
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(500));
+
+  buffer_manager.transaction_complete(1);
+  sleep(TIMEOUT);
+  EXPECT_TRUE(lock.is_acquired());
+  buffer_manager.transaction_complete(2);
+}
+
+/**
+   * Concurrent transactions on a small buffer evict each other's pages
+   */
+TEST(BufferManagerTransactionTest, ConcurrentEviction){
+  BufferManager buffer_manager(128, 8);
+  buffer_manager.discard_all_pages();
+  std::vector<std::thread> threads;
+  for (uint64_t thread = 0; thread < 4; thread++) {
+    threads.emplace_back([&buffer_manager, thread]() {
+      for (uint64_t i = 0; i < 100; i++) {
+        uint64_t txn_id = thread * 1000 + i + 1;
+        uint64_t page_id = BufferManager::get_overall_page_id(126, thread * 1000 + i % 20);
+        auto& page = buffer_manager.fix_page(txn_id, page_id, true);
+        page.get_data()[0] = static_cast<char>(i);
+        buffer_manager.unfix_page(txn_id, page, true);
+        buffer_manager.transaction_complete(txn_id);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  buffer_manager.discard_all_pages();
+  for (uint64_t thread = 0; thread < 4; thread++) {
+    for (uint64_t i = 80; i < 100; i++) {
+      uint64_t txn_id = 10000 + thread * 1000 + i;
+      uint64_t page_id = BufferManager::get_overall_page_id(126, thread * 1000 + i % 20);
+      auto& page = buffer_manager.fix_page(txn_id, page_id, false);
+      EXPECT_EQ(static_cast<char>(i), page.get_data()[0]);
+      buffer_manager.unfix_page(txn_id, page, false);
+      buffer_manager.transaction_complete(txn_id);
+    }
+  }
+}
+
+/**
+   * Pages are fixed again while they are written back to be evicted, no
+   * update is lost
+   */
+TEST(BufferManagerTransactionTest, FixEvictingPages){
+  BufferManager buffer_manager(128, 4);
+  buffer_manager.discard_all_pages();
+  for (uint64_t i = 0; i < 16; i++) {
+    uint64_t page_id = BufferManager::get_overall_page_id(126, 5000 + i);
+    auto& page = buffer_manager.fix_page(1, page_id, true);
+    memset(page.get_data(), 0, 128);
+    buffer_manager.unfix_page(1, page, true);
+    buffer_manager.transaction_complete(1);
+  }
+
+  std::vector<std::thread> threads;
+  for (uint64_t thread = 0; thread < 4; thread++) {
+    threads.emplace_back([&buffer_manager, thread]() {
+      for (uint64_t i = 0; i < 200; i++) {
+        uint64_t txn_id = 2 + thread * 1000 + i;
+        uint64_t page_id = BufferManager::get_overall_page_id(126, 5000 + (thread + i) % 16);
+        auto& page = buffer_manager.fix_page(txn_id, page_id, true);
+        {
+          std::unique_lock<buzzdb::RWLatch> latch(page.get_latch());
+          page.get_data()[0]++;
+        }
+        buffer_manager.unfix_page(txn_id, page, true);
+        buffer_manager.transaction_complete(txn_id);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  buffer_manager.discard_all_pages();
+  size_t updates = 0;
+  for (uint64_t i = 0; i < 16; i++) {
+    uint64_t page_id = BufferManager::get_overall_page_id(126, 5000 + i);
+    auto& page = buffer_manager.fix_page(10000 + i, page_id, false);
+    updates += static_cast<unsigned char>(page.get_data()[0]);
+    buffer_manager.unfix_page(10000 + i, page, false);
+    buffer_manager.transaction_complete(10000 + i);
+  }
+  EXPECT_EQ(4 * 200u, updates);
+}
+
+/**
+   * Aborting a transaction keeps a page that it shares with another
+   * transaction
+   */
+TEST(BufferManagerTransactionTest, AbortKeepsSharedPages){
+  BufferManager buffer_manager(128, 2);
+  buffer_manager.discard_all_pages();
+  uint64_t page_id = BufferManager::get_overall_page_id(127, 0);
+  auto& page = buffer_manager.fix_page(1, page_id, true);
+  memset(page.get_data(), 1, 128);
+  buffer_manager.unfix_page(1, page, true);
+  buffer_manager.transaction_complete(1);
+
+  // Transactions 2 and 3 lock the page shared, 3 keeps it pinned
+  auto& page_2 = buffer_manager.fix_page(2, page_id, false);
+  buffer_manager.unfix_page(2, page_2, false);
+  auto& page_3 = buffer_manager.fix_page(3, page_id, false);
+  buffer_manager.transaction_abort(2);
+
+  // Other pages must not be loaded into the frame of transaction 3
+  for (uint64_t txn_id = 4; txn_id <= 8; txn_id++) {
+    uint64_t other_id = BufferManager::get_overall_page_id(127, txn_id);
+    auto& other = buffer_manager.fix_page(txn_id, other_id, true);
+    memset(other.get_data(), static_cast<int>(txn_id), 128);
+    buffer_manager.unfix_page(txn_id, other, true);
+    buffer_manager.transaction_complete(txn_id);
+  }
+  EXPECT_EQ(1, page_3.get_data()[127]);
+  buffer_manager.unfix_page(3, page_3, false);
+  buffer_manager.transaction_complete(3);
+}
+
+/**
+   * A page that is discarded while it is pinned keeps its frame until it is
+   * unfixed, but is not written back
+   */
+TEST(BufferManagerTransactionTest, DiscardPinnedPage){
+  BufferManager buffer_manager(128, 2);
+  buffer_manager.discard_all_pages();
+  uint64_t page_id = BufferManager::get_overall_page_id(127, 0);
+  auto& page = buffer_manager.fix_page(1, page_id, true);
+  memset(page.get_data(), 1, 128);
+  buffer_manager.unfix_page(1, page, true);
+  buffer_manager.transaction_complete(1);
+
+  auto& pinned = buffer_manager.fix_page(2, page_id, true);
+  memset(pinned.get_data(), 2, 128);
+  pinned.mark_dirty();
+  buffer_manager.transaction_abort(2);
+  buffer_manager.flush_all_pages();
+
+  // The page is loaded again into the other frame
+  auto& page_3 = buffer_manager.fix_page(3, page_id, false);
+  EXPECT_NE(&pinned, &page_3);
+  EXPECT_EQ(1, page_3.get_data()[127]);
+  EXPECT_EQ(2, pinned.get_data()[127]);
+  buffer_manager.unfix_page(2, pinned, true);
+  buffer_manager.unfix_page(3, page_3, false);
+  buffer_manager.transaction_complete(3);
+
+  // The last unfix freed the frame
+  auto& page_4 = buffer_manager.fix_page(4, BufferManager::get_overall_page_id(127, 1), false);
+  auto& page_5 = buffer_manager.fix_page(4, BufferManager::get_overall_page_id(127, 2), false);
+  buffer_manager.unfix_page(4, page_4, false);
+  buffer_manager.unfix_page(4, page_5, false);
+  buffer_manager.transaction_complete(4);
+}
+
+
+/**
+   * Discarding all pages keeps the bytes of a pinned page until it is
+   * unfixed, and frees its frame then
+   */
+TEST(BufferManagerTransactionTest, DiscardAllPinnedPages){
+  BufferManager buffer_manager(128, 2);
+  buffer_manager.discard_all_pages();
+  uint64_t page_id = BufferManager::get_overall_page_id(127, 10);
+  auto& page = buffer_manager.fix_page(1, page_id, true);
+  memset(page.get_data(), 1, 128);
+  buffer_manager.unfix_page(1, page, true);
+  buffer_manager.transaction_complete(1);
+
+  auto& pinned = buffer_manager.fix_page(2, page_id, false);
+  buffer_manager.discard_all_pages();
+  EXPECT_EQ(1, pinned.get_data()[127]);
+
+  // The page is loaded again into the other frame
+  auto& page_3 = buffer_manager.fix_page(3, page_id, false);
+  EXPECT_NE(&pinned, &page_3);
+  EXPECT_EQ(1, page_3.get_data()[127]);
+  buffer_manager.unfix_page(2, pinned, false);
+  buffer_manager.unfix_page(3, page_3, false);
+  buffer_manager.transaction_complete(2);
+  buffer_manager.transaction_complete(3);
+
+  // Both frames are free again
+  buffer_manager.discard_all_pages();
+  auto& page_4 = buffer_manager.fix_page(4, BufferManager::get_overall_page_id(127, 11), false);
+  auto& page_5 = buffer_manager.fix_page(4, BufferManager::get_overall_page_id(127, 12), false);
+  buffer_manager.unfix_page(4, page_4, false);
+  buffer_manager.unfix_page(4, page_5, false);
+  buffer_manager.transaction_complete(4);
+}
+
 TEST(DeadlockTest, ReadWriteDeadlock){
   BufferManager buffer_manager(128, 10);
   uint64_t p1 = 1, p2 = 2;
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "common/rw_latch.h"
+
+using buzzdb::RWLatch;
+
+namespace {
+
+TEST(RWLatchTest, SharedAndExclusive) {
+  RWLatch latch;
+  ASSERT_TRUE(latch.try_lock_shared());
+  ASSERT_TRUE(latch.try_lock_shared());
+  ASSERT_FALSE(latch.try_lock());
+  latch.unlock_shared();
+  latch.unlock_shared();
+
+  ASSERT_TRUE(latch.try_lock());
+  ASSERT_FALSE(latch.try_lock());
+  ASSERT_FALSE(latch.try_lock_shared());
+  latch.unlock();
+  ASSERT_TRUE(latch.try_lock_shared());
+  latch.unlock_shared();
+}
+
+TEST(RWLatchTest, WaitingWriterKeepsReadersOut) {
+  RWLatch latch;
+  latch.lock_shared();
+
+  std::atomic<bool> locked{false};
+  std::thread writer([&]() {
+    std::unique_lock<RWLatch> lock(latch);
+    locked = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  ASSERT_FALSE(locked);
+  ASSERT_FALSE(latch.try_lock_shared());
+
+  latch.unlock_shared();
+  writer.join();
+  ASSERT_TRUE(locked);
+  ASSERT_TRUE(latch.try_lock_shared());
+  latch.unlock_shared();
+}
+
+TEST(RWLatchTest, Counter) {
+  RWLatch latch;
+  uint64_t counter = 0;
+  std::vector<std::thread> threads;
+  for (size_t thread = 0; thread < 4; thread++) {
+    threads.emplace_back([&]() {
+      for (size_t i = 0; i < 10000; i++) {
+        if (i % 4 == 0) {
+          std::unique_lock<RWLatch> lock(latch);
+          counter++;
+        } else {
+          std::shared_lock<RWLatch> lock(latch);
+          ASSERT_LE(counter, 4 * 10000u);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(4 * 2500u, counter);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}